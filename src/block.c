@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block.h"
+
+/* Make room for n cells; returns 0 when out of memory */
+static int reserve(block_t *b, int n)
+{
+    char *cells;
+
+    if (n <= b->capacity)
+    {
+        return 1;
+    }
+    cells = realloc(b->cells, n);
+    if (!cells)
+    {
+        return 0;
+    }
+    b->cells = cells;
+    b->capacity = n;
+    return 1;
+}
+
+block_t *block_new(void)
+{
+    return calloc(1, sizeof(block_t));
+}
+
+void block_free(block_t *b)
+{
+    if (b)
+    {
+        free(b->cells);
+        free(b);
+    }
+}
+
+int block_copy(block_t *b, ecl_t *ecl, int x, int y, int w, int h)
+{
+    if (!b || !ecl || w < 1 || h < 1 || !reserve(b, w * h))
+    {
+        return 0;
+    }
+    b->w = w;
+    b->h = h;
+    ecl_extract(ecl, x, y, w, h, b->cells);
+    return 1;
+}
+
+int block_cut(block_t *b, journal_t *j, ecl_t *ecl, int x, int y, int w, int h)
+{
+    if (!block_copy(b, ecl, x, y, w, h))
+    {
+        return 0;
+    }
+    block_fill(j, ecl, x, y, w, h, '.');
+    return 1;
+}
+
+void block_paste(const block_t *b, journal_t *j, ecl_t *ecl, int x, int y)
+{
+    if (!b || !ecl || !b->w)
+    {
+        return;
+    }
+    journal_begin(j);
+    journal_touch_rect(j, ecl, x, y, b->w, b->h);
+    ecl_blit(ecl, x, y, b->cells, b->w, b->h, 0);
+    journal_end(j, ecl);
+}
+
+void block_fill(journal_t *j, ecl_t *ecl, int x, int y, int w, int h, char val)
+{
+    int col, row, x1, y1;
+
+    if (!ecl)
+    {
+        return;
+    }
+    journal_begin(j);
+    journal_touch_rect(j, ecl, x, y, w, h);
+    x1 = (x + w < ecl->width) ? x + w : ecl->width;
+    y1 = (y + h < ecl->height) ? y + h : ecl->height;
+    x = (x < 0) ? 0 : x;
+    y = (y < 0) ? 0 : y;
+    val = valid_char(val) ? val : '.';
+    for (col = x; col < x1 && y < y1; col++)
+    {
+        memset(ecl->mem + (size_t)col * ecl->height + y, val, y1 - y);
+        for (row = y; ecl->wide && row < y1; row++)
+        {
+            ecl->wide[col * ecl->height + row] = char2int(val);
+        }
+    }
+    ecl_invalidate(ecl);
+    journal_end(j, ecl);
+}
+
+void block_move(journal_t *j, ecl_t *ecl, int x, int y, int w, int h, int dx, int dy)
+{
+    block_t b = {0, 0, 0, 0};
+
+    if (!ecl || !block_copy(&b, ecl, x, y, w, h))
+    {
+        return;
+    }
+    /* one rectangle covering both places, so the move undoes in one step */
+    journal_begin(j);
+    journal_touch_rect(j, ecl, dx < 0 ? x + dx : x, dy < 0 ? y + dy : y,
+                       w + abs(dx), h + abs(dy));
+    block_fill(0, ecl, x, y, w, h, '.');
+    ecl_blit(ecl, x + dx, y + dy, b.cells, w, h, 0);
+    journal_end(j, ecl);
+    free(b.cells);
+}
+
+int block_rotate(block_t *b)
+{
+    char *cells;
+    int x, y;
+
+    if (!b || !b->w)
+    {
+        return 0;
+    }
+    cells = malloc(b->capacity);
+    if (!cells)
+    {
+        return 0;
+    }
+    /* (x, y) lands on column h - 1 - y, row x of the turned block */
+    for (x = 0; x < b->w; x++)
+    {
+        for (y = 0; y < b->h; y++)
+        {
+            cells[(b->h - 1 - y) * b->w + x] = b->cells[x * b->h + y];
+        }
+    }
+    free(b->cells);
+    b->cells = cells;
+    x = b->w;
+    b->w = b->h;
+    b->h = x;
+    return 1;
+}
+
+/* Swap n cells of a and b, stepping a by one and b by step */
+static void swap_cells(char *a, char *b, int n, int step)
+{
+    char c;
+
+    for (; n > 0; n--, a++, b += step)
+    {
+        c = *a;
+        *a = *b;
+        *b = c;
+    }
+}
+
+void block_flip(block_t *b, int vertical)
+{
+    int x;
+
+    if (!b)
+    {
+        return;
+    }
+    if (vertical)
+    { /* reverse every column */
+        for (x = 0; x < b->w; x++)
+        {
+            swap_cells(b->cells + x * b->h, b->cells + x * b->h + b->h - 1, b->h / 2, -1);
+        }
+        return;
+    }
+    for (x = 0; x < b->w / 2; x++)
+    {
+        swap_cells(b->cells + x * b->h, b->cells + (b->w - 1 - x) * b->h, b->h, 1);
+    }
+}
+
+char *block_to_text(const block_t *b)
+{
+    char *text, *p;
+    int x;
+
+    if (!b)
+    {
+        return 0;
+    }
+    p = text = malloc((size_t)b->w * (b->h + 1) + 1);
+    if (!text)
+    {
+        return 0;
+    }
+    for (x = 0; x < b->w; x++)
+    {
+        memcpy(p, b->cells + x * b->h, b->h);
+        p += b->h;
+        *p++ = '\n';
+    }
+    *p = '\0';
+    return text;
+}
+
+int block_from_text(block_t *b, const char *text)
+{
+    int w, h;
+    char *cells;
+
+    if (!b || !text || !(cells = ecl_parse_region(text, strlen(text), &w, &h)))
+    {
+        return 0;
+    }
+    free(b->cells);
+    b->cells = cells;
+    b->capacity = w * h;
+    b->w = w;
+    b->h = h;
+    return 1;
+}
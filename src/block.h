@@ -0,0 +1,56 @@
+
+#ifndef _BLOCK_H_
+#define _BLOCK_H_
+
+#include <stdio.h>
+
+#include "ecl.h"
+#include "journal.h"
+
+/* Rectangular blocks of cells: the clipboard and the block edits of the
+   editor. A block is stored column by column like memory, so copying to and
+   from memory is a memcpy per column. Edits to memory go through a journal
+   as whole rectangles and undo in one step; the journal may be null. */
+typedef struct block_t
+{
+  int w, h;
+  char *cells; /* w * h values, column by column */
+  int capacity;
+} block_t;
+
+/* Create an empty block */
+block_t *block_new(void);
+
+/* Destroy a block */
+void block_free(block_t *b);
+
+/* Copy the w by h rectangle at column x, row y into b; returns 0 when out
+   of memory */
+int block_copy(block_t *b, ecl_t *ecl, int x, int y, int w, int h);
+
+/* Copy the rectangle into b and clear it */
+int block_cut(block_t *b, journal_t *j, ecl_t *ecl, int x, int y, int w, int h);
+
+/* Write b to memory with its top left at column x, row y */
+void block_paste(const block_t *b, journal_t *j, ecl_t *ecl, int x, int y);
+
+/* Set every cell of the rectangle to val */
+void block_fill(journal_t *j, ecl_t *ecl, int x, int y, int w, int h, char val);
+
+/* Move the rectangle by dx columns and dy rows, clearing where it was */
+void block_move(journal_t *j, ecl_t *ecl, int x, int y, int w, int h, int dx, int dy);
+
+/* Turn b a quarter clockwise; its width and height swap */
+int block_rotate(block_t *b);
+
+/* Mirror b left to right, or top to bottom with vertical set */
+void block_flip(block_t *b, int vertical);
+
+/* b as text, one column per line as ecl_save writes it, for the system
+   clipboard; free the result */
+char *block_to_text(const block_t *b);
+
+/* Set b from text in the same format; returns 0 when there are no cells */
+int block_from_text(block_t *b, const char *text);
+
+#endif
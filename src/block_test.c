@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "block.h"
+#include "journal.h"
+
+/* Columns of the w by h rectangle at x, y as one string */
+static const char *region(ecl_t *ecl, int x, int y, int w, int h)
+{
+  static char out[64];
+
+  ecl_extract(ecl, x, y, w, h, out);
+  out[w * h] = '\0';
+  return out;
+}
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(8, 8, (unsigned long)1);
+  journal_t *j = journal_new();
+  block_t *b = block_new();
+  char saved[64], *text;
+  int ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  ecl_blit(ecl, 1, 1, "123456", 2, 3, 0); /* columns 123 and 456 */
+  memcpy(saved, ecl->mem, ecl->memsz);
+
+  /* cut and paste elsewhere, each one undo step */
+  block_cut(b, j, ecl, 1, 1, 2, 3);
+  block_paste(b, j, ecl, 5, 4);
+  if (strcmp(region(ecl, 1, 1, 2, 3), "......") || strcmp(region(ecl, 5, 4, 2, 3), "123456"))
+  {
+    printf("block: bad cut and paste\n");
+    ok = 0;
+  }
+  journal_undo(j, ecl);
+  journal_undo(j, ecl);
+  if (memcmp(saved, ecl->mem, ecl->memsz))
+  {
+    printf("block: cut and paste do not undo\n");
+    ok = 0;
+  }
+
+  /* a quarter turn, and four of them */
+  block_copy(b, ecl, 1, 1, 2, 3);
+  block_rotate(b);
+  if (b->w != 3 || b->h != 2 || memcmp(b->cells, "3625" "14", 6))
+  {
+    printf("block: bad rotation\n");
+    ok = 0;
+  }
+  block_rotate(b);
+  block_rotate(b);
+  block_rotate(b);
+  if (b->w != 2 || memcmp(b->cells, "123456", 6))
+  {
+    printf("block: four turns are not the identity\n");
+    ok = 0;
+  }
+
+  block_flip(b, 0);
+  if (memcmp(b->cells, "456123", 6))
+  {
+    printf("block: bad horizontal flip\n");
+    ok = 0;
+  }
+  block_flip(b, 1);
+  if (memcmp(b->cells, "654321", 6))
+  {
+    printf("block: bad vertical flip\n");
+    ok = 0;
+  }
+
+  /* overlapping move, undone as one rectangle */
+  block_move(j, ecl, 1, 1, 2, 3, 1, 1);
+  if (strcmp(region(ecl, 1, 1, 3, 4), "...." ".123" ".456"))
+  {
+    printf("block: bad move\n");
+    ok = 0;
+  }
+  journal_undo(j, ecl);
+  if (memcmp(saved, ecl->mem, ecl->memsz))
+  {
+    printf("block: move does not undo\n");
+    ok = 0;
+  }
+
+  block_fill(j, ecl, 6, 6, 4, 4, 'A');
+  if (strcmp(region(ecl, 6, 6, 2, 2), "AAAA") || ecl_get(ecl, 6 * 8 + 5) != '.')
+  {
+    printf("block: bad fill\n");
+    ok = 0;
+  }
+
+  /* wide values are cleared with their glyphs and come back on undo */
+  ecl_set_wide(ecl, 1);
+  ecl_set_num(ecl, 3 * 8 + 3, 1000);
+  block_fill(j, ecl, 3, 3, 2, 2, '.');
+  if (ecl_get_num(ecl, 3 * 8 + 3) != 0)
+  {
+    printf("block: fill left a wide value\n");
+    ok = 0;
+  }
+  journal_undo(j, ecl);
+  if (ecl_get_num(ecl, 3 * 8 + 3) != 1000)
+  {
+    printf("block: undo lost a wide value\n");
+    ok = 0;
+  }
+  journal_redo(j, ecl);
+  if (ecl_get_num(ecl, 3 * 8 + 3) != 0)
+  {
+    printf("block: redo lost a wide value\n");
+    ok = 0;
+  }
+  ecl_set_wide(ecl, 0);
+
+  /* clipboard text, one column per line */
+  block_copy(b, ecl, 1, 1, 2, 3);
+  text = block_to_text(b);
+  if (!text || strcmp(text, "123\n456\n") || !block_from_text(b, "ab\r\nc\n") ||
+      b->w != 2 || b->h != 2 || memcmp(b->cells, "abc.", 4))
+  {
+    printf("block: bad clipboard text\n");
+    ok = 0;
+  }
+  free(text);
+
+  block_free(b);
+  journal_free(j);
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "block ok" : "block FAILED");
+  return !ok;
+}
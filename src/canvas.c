@@ -0,0 +1,202 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "canvas.h"
+#include "font.h"
+
+static const uint32_t theme[] = {
+    0x000000,
+    0x72DEC2,
+    0xFFFFFF,
+    0x444444,
+    0xffff00,
+    0x666666,
+    0xffb545};
+
+canvas_t *canvas_new(int cols, int rows, int pad)
+{
+    canvas_t *c = calloc(1, sizeof(canvas_t));
+
+    if (!c)
+    {
+        return 0;
+    }
+    c->cols = cols;
+    c->rows = rows;
+    c->pad = pad;
+    c->width = 8 * cols + pad * 2;
+    c->height = 8 * rows + pad * 2;
+    c->pixels = calloc((size_t)c->width * c->height, sizeof(uint32_t)); /* black */
+    if (!c->pixels)
+    {
+        free(c);
+        return 0;
+    }
+    return c;
+}
+
+void canvas_free(canvas_t *c)
+{
+    if (c)
+    {
+        free(c->pixels);
+        free(c);
+    }
+}
+
+int canvas_style(ecl_t *ecl, int i)
+{
+    if (ecl_get_visual(ecl, i) >= ECL_VISUAL_FIRE / 2)
+    { /* fired within the last few ticks */
+        return CANVAS_FIRED;
+    }
+    switch (ecl_get_state(ecl, i))
+    {
+    case STATE_CMD:
+        return CANVAS_COMMAND;
+    case STATE_NUM:
+    case STATE_ARG:
+    case STATE_NEW:
+        return CANVAS_VALUE;
+    case STATE_EMPTY:
+    default:
+        return CANVAS_EMPTY;
+    }
+}
+
+void canvas_capture(ecl_t *ecl, char *cells, unsigned char *styles)
+{
+    int i;
+
+    for (i = 0; i < ecl->memsz; i++)
+    {
+        cells[i] = ecl->mem[i];
+        styles[i] = (unsigned char)canvas_style(ecl, i);
+    }
+}
+
+int canvas_glyph(int col, int row, char v, int style, int sel)
+{
+    if (valid_char(v))
+    {
+        return v & 127;
+    }
+    else if (col % 8 == 0 && row % 8 == 0)
+    {
+        return '+';
+    }
+    else if (sel || style || (col % 2 == 0 && row % 2 == 0))
+    {
+        return '.';
+    }
+    return v & 127;
+}
+
+/* Theme color of a glyph pixel that is on (on != 0) or off */
+static int color(int on, int style, int sel)
+{
+    if (sel)
+        return on == 0 ? 4 : 0;
+    if (style == 2)
+        return on == 0 ? 0 : 1;
+    if (style == 3)
+        return on == 0 ? 1 : 0;
+    if (style == 4)
+        return on == 0 ? 0 : 2;
+    if (style == 5)
+        return on == 0 ? 2 : 0;
+    return on == 0 ? 0 : 3;
+}
+
+void canvas_tile(canvas_t *c, int col, int row, char v, int style, int sel)
+{
+    const unsigned char *bitmap = font[canvas_glyph(col, row, v, style, sel)];
+    uint32_t *p;
+    int y, x;
+
+    if (col < 0 || col >= c->cols || row < 0 || row >= c->rows)
+    {
+        return;
+    }
+    for (y = 0; y < 8; y++)
+    {
+        p = c->pixels + (size_t)(row * 8 + y + c->pad) * c->width + col * 8 + c->pad;
+        for (x = 0; x < 8; x++)
+        {
+            p[x] = theme[color(bitmap[y] & 1 << x, style, sel)];
+        }
+    }
+}
+
+void canvas_draw(canvas_t *c, const char *cells, const unsigned char *styles,
+                 int sx, int sy, int w, int h)
+{
+    int col, row, i, sel;
+
+    for (col = 0; col < c->cols; col++)
+    {
+        for (row = 0; row < c->rows; row++)
+        {
+            i = col * c->rows + row;
+            sel = col >= sx && col < sx + w && row >= sy && row < sy + h;
+            canvas_tile(c, col, row, cells[i], styles[i], sel);
+        }
+    }
+}
+
+void canvas_tint(canvas_t *c, int col, int row, float a)
+{
+    uint32_t *p;
+    int y, x, r, g, b;
+
+    if (col < 0 || col >= c->cols || row < 0 || row >= c->rows)
+    {
+        return;
+    }
+    for (y = 0; y < 8; y++)
+    {
+        p = c->pixels + (size_t)(row * 8 + y + c->pad) * c->width + col * 8 + c->pad;
+        for (x = 0; x < 8; x++)
+        {
+            r = (p[x] >> 16) & 0xff;
+            g = (p[x] >> 8) & 0xff;
+            b = p[x] & 0xff;
+            r += (int)((0xff - r) * a);
+            g += (int)((0x40 - g) * a);
+            b += (int)((0x20 - b) * a);
+            p[x] = (uint32_t)(r << 16 | g << 8 | b);
+        }
+    }
+}
+
+void canvas_rgba(const canvas_t *c, unsigned char *out)
+{
+    size_t i, n = (size_t)c->width * c->height;
+
+    for (i = 0; i < n; i++, out += 4)
+    {
+        out[0] = (unsigned char)(c->pixels[i] >> 16);
+        out[1] = (unsigned char)(c->pixels[i] >> 8);
+        out[2] = (unsigned char)c->pixels[i];
+        out[3] = 0xff;
+    }
+}
+
+void canvas_yuv(const canvas_t *c, unsigned char *out)
+{
+    size_t i, n = (size_t)c->width * c->height;
+    int r, g, b;
+
+    /* fixed point BT.601 scaled by 256; the chroma offset of 128 is folded
+       in before the shift so it never sees a negative value */
+    for (i = 0; i < n; i++)
+    {
+        r = (c->pixels[i] >> 16) & 0xff;
+        g = (c->pixels[i] >> 8) & 0xff;
+        b = c->pixels[i] & 0xff;
+        out[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        out[n + i] = (unsigned char)((-38 * r - 74 * g + 112 * b + 32896) >> 8);
+        out[2 * n + i] = (unsigned char)((112 * r - 94 * g - 18 * b + 32896) >> 8);
+    }
+}
@@ -0,0 +1,65 @@
+
+#ifndef _CANVAS_H_
+#define _CANVAS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* The picture of a grid as the editor draws it: an 8x8 glyph from font.h
+   per cell, styled by its state, on a pixel buffer with a border. Nothing
+   here needs SDL, so the window and the offline renderer draw the same
+   pixels. Cells are addressed by column and row. */
+
+/* Tile styles */
+enum
+{
+  CANVAS_EMPTY = 1,
+  CANVAS_VALUE = 2, /* numbers and arguments */
+  CANVAS_COMMAND = 3,
+  CANVAS_FIRED = 5 /* cells that fired within the last few ticks */
+};
+
+typedef struct canvas_t
+{
+  int cols, rows, pad;
+  int width, height; /* pixels, border included */
+  uint32_t *pixels;  /* 0xRRGGBB, row by row */
+} canvas_t;
+
+/* A canvas for cols by rows cells with a border of pad pixels */
+canvas_t *canvas_new(int cols, int rows, int pad);
+
+/* Destroy a canvas */
+void canvas_free(canvas_t *c);
+
+/* Style of the cell at memory position i as of the last tick */
+int canvas_style(ecl_t *ecl, int i);
+
+/* Copy what a frame shows of ecl: the value and style of every cell, each
+   memsz bytes, so the frame can be drawn later on another thread */
+void canvas_capture(ecl_t *ecl, char *cells, unsigned char *styles);
+
+/* Character a tile shows: its value, or a grid mark on empty cells */
+int canvas_glyph(int col, int row, char v, int style, int sel);
+
+/* Draw one tile; sel draws it as selected */
+void canvas_tile(canvas_t *c, int col, int row, char v, int style, int sel);
+
+/* Draw captured cells, column by column; the w by h rectangle at column
+   sx, row sy is drawn selected (w = 0 for none) */
+void canvas_draw(canvas_t *c, const char *cells, const unsigned char *styles,
+                 int sx, int sy, int w, int h);
+
+/* Blend a drawn tile towards the hot color by a in [0, 1] */
+void canvas_tint(canvas_t *c, int col, int row, float a);
+
+/* Write the pixels as RGBA, 4 bytes a pixel */
+void canvas_rgba(const canvas_t *c, unsigned char *out);
+
+/* Write the pixels as planar 4:4:4 YUV (BT.601, studio range), 3 bytes a
+   pixel: the Y plane, then U, then V */
+void canvas_yuv(const canvas_t *c, unsigned char *out);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "canvas.h"
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(4, 4, (unsigned long)1);
+  canvas_t *c = canvas_new(4, 4, 8);
+  char cells[16];
+  unsigned char styles[16], *rgba, *yuv;
+  int i, lit = 0, ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* an A command at column 1, row 2 is drawn bold: black on turquoise */
+  ecl_set(ecl, 1 * 4 + 2, 'A');
+  ecl_eval(ecl);
+  canvas_capture(ecl, cells, styles);
+  if (c->width != 48 || c->height != 48 || cells[6] != 'A' || styles[6] != CANVAS_COMMAND)
+  {
+    printf("canvas: bad capture\n");
+    ok = 0;
+  }
+  canvas_draw(c, cells, styles, 0, 0, 0, 0);
+  for (i = 0; i < 64; i++)
+  { /* pixels of the tile at x 16..23, y 24..31 after the border */
+    lit += c->pixels[(8 + 16 + i / 8) * c->width + 8 + 8 + i % 8] == 0x72DEC2;
+  }
+  if (lit == 0 || lit == 64 || c->pixels[0] != 0)
+  {
+    printf("canvas: bad tile, %d turquoise pixels\n", lit);
+    ok = 0;
+  }
+
+  /* black and white in both output formats */
+  yuv = malloc((size_t)c->width * c->height * 3);
+  rgba = malloc((size_t)c->width * c->height * 4);
+  canvas_yuv(c, yuv);
+  canvas_rgba(c, rgba);
+  if (yuv[0] != 16 || yuv[c->width * c->height] != 128 || memcmp(rgba, "\0\0\0\xff", 4))
+  {
+    printf("canvas: bad black\n");
+    ok = 0;
+  }
+  c->pixels[0] = 0xFFFFFF;
+  canvas_yuv(c, yuv);
+  if (yuv[0] != 235 || yuv[c->width * c->height] != 128 || yuv[2 * c->width * c->height] != 128)
+  {
+    printf("canvas: bad white\n");
+    ok = 0;
+  }
+
+  free(rgba);
+  free(yuv);
+  canvas_free(c);
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "canvas ok" : "canvas FAILED");
+  return !ok;
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "reference.h"
+
+/* Column 0 on the main clock, 1 at half speed, 2 at double speed and 3, a
+   G, at a quarter */
+static ecl_t *grid(void)
+{
+  ecl_t *ecl = ecl_new(4, 8, (unsigned long)1);
+
+  ecl_blit(ecl, 0, 0, "5.......5.......5.......G19.....", 4, 8, 0);
+  if (!ecl_set_clock(ecl, 1, 1, 1, 1, 2) || !ecl_clock_spec(ecl, "2=2,1,2") ||
+      !ecl_clock_spec(ecl, "3=3,1,1/4"))
+  {
+    ecl_free(ecl);
+    return 0;
+  }
+  return ecl;
+}
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = grid(), *ref = grid();
+  int t, ok = ecl && ref;
+
+  (void)argc;
+  (void)argv;
+
+  if (ok && (ecl_set_clock(ecl, 4, 1, 2, 1, 1) || ecl_set_clock(ecl, 4, 0, 1, 0, 1)))
+  {
+    printf("clock: bad clock accepted\n");
+    ok = 0;
+  }
+  for (t = 0; ok && t < 2; t++)
+  {
+    ecl_eval(ecl);
+    reference_eval(ref);
+  }
+  if (ok && (ecl_get(ecl, 0 * 8 + 2) != '5' || ecl_get(ecl, 1 * 8 + 1) != '5' ||
+             ecl_get(ecl, 2 * 8 + 4) != '5'))
+  {
+    printf("clock: numbers moved at the wrong rates\n");
+    ok = 0;
+  }
+  for (t = 0; ok && t < 2; t++)
+  {
+    ecl_eval(ecl);
+    reference_eval(ref);
+  }
+  /* the quarter clock ticked once, on the fourth tick, as its tick 0 */
+  if (ok && (ecl_get(ecl, 1 * 8 + 2) != '5' || ecl_get(ecl, 3 * 8 + 3) != '2'))
+  {
+    printf("clock: slow columns at the wrong tick\n");
+    ok = 0;
+  }
+  if (ok && memcmp(ecl->mem, ref->mem, ecl->memsz))
+  {
+    printf("clock: differs from the reference\n");
+    ok = 0;
+  }
+
+  ecl_free(ecl);
+  ecl_free(ref);
+
+  printf("%s\n", ok ? "clock ok" : "clock FAILED");
+  return !ok;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "delta.h"
+
+int delta_frame_bytes(int memsz, int wide)
+{
+    return memsz * 2 + BASE36 + (wide ? (memsz + BASE36) * 4 : 0);
+}
+
+int delta_frame_size(ecl_t *ecl)
+{
+    return delta_frame_bytes(ecl->memsz, ecl->wide != 0);
+}
+
+static void put_u32(unsigned char *p, int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static int get_u32(const unsigned char *p)
+{
+    return (int)((unsigned int)p[0] | (unsigned int)p[1] << 8 |
+                 (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24);
+}
+
+void delta_capture(ecl_t *ecl, unsigned char *frame)
+{
+    int i;
+    memcpy(frame, ecl->mem, ecl->memsz);
+    for (i = 0; i < ecl->memsz; i++)
+    {
+        frame[ecl->memsz + i] = (unsigned char)ecl->state[i];
+    }
+    memcpy(frame + ecl->memsz * 2, ecl->vars, BASE36);
+    if (ecl->wide)
+    {
+        frame += ecl->memsz * 2 + BASE36;
+        for (i = 0; i < ecl->memsz; i++)
+        {
+            put_u32(frame + i * 4, ecl->wide[i]);
+        }
+        for (i = 0; i < BASE36; i++)
+        {
+            put_u32(frame + (ecl->memsz + i) * 4, ecl->var_values[i]);
+        }
+    }
+}
+
+void delta_restore(ecl_t *ecl, const unsigned char *frame)
+{
+    int i;
+    memcpy(ecl->mem, frame, ecl->memsz);
+    for (i = 0; i < ecl->memsz; i++)
+    {
+        ecl->state[i] = frame[ecl->memsz + i];
+    }
+    memcpy(ecl->vars, frame + ecl->memsz * 2, BASE36);
+    if (ecl->wide)
+    {
+        frame += ecl->memsz * 2 + BASE36;
+        for (i = 0; i < ecl->memsz; i++)
+        {
+            ecl->wide[i] = get_u32(frame + i * 4);
+        }
+        for (i = 0; i < BASE36; i++)
+        {
+            ecl->var_values[i] = get_u32(frame + (ecl->memsz + i) * 4);
+        }
+    }
+    memset(ecl->channels, 0, sizeof(ecl->channels));
+    ecl_invalidate(ecl);
+}
+
+/* A run costs at most gap + 1 bytes of header, length bytes of values and,
+   when longer than seven, length - 7 bytes of extension; there are at most
+   (n + 1) / 2 runs */
+size_t delta_bound(int n)
+{
+    return (size_t)n * 5 / 2 + 2;
+}
+
+static unsigned char *put_varint(unsigned char *p, unsigned int v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (unsigned char)((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, unsigned int *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    do
+    {
+        if (*p == end || shift > 28)
+        {
+            return 0;
+        }
+        *v |= (unsigned int)(**p & 0x7f) << shift;
+        shift += 7;
+    } while (*(*p)++ & 0x80);
+    return 1;
+}
+
+size_t delta_encode(const unsigned char *prev, const unsigned char *cur, int n,
+                    unsigned char *out)
+{
+    unsigned char *p = out;
+    int i = 0, start, last = 0;
+
+    while (i < n)
+    {
+        if (prev[i] == cur[i])
+        {
+            i++;
+            continue;
+        }
+        start = i;
+        while (i < n && prev[i] != cur[i])
+        {
+            i++;
+        }
+        if (i - start < 8)
+        {
+            p = put_varint(p, (unsigned int)(start - last) << 3 | (i - start - 1));
+        }
+        else
+        {
+            p = put_varint(p, (unsigned int)(start - last) << 3 | 7);
+            p = put_varint(p, (unsigned int)(i - start - 8));
+        }
+        memcpy(p, cur + start, i - start);
+        p += i - start;
+        last = i;
+    }
+    return p - out;
+}
+
+int delta_apply(unsigned char *frame, int n, const unsigned char *delta, size_t len)
+{
+    const unsigned char *p = delta, *end = delta + len;
+    unsigned int head, gap, run, at = 0;
+
+    while (p < end)
+    {
+        if (!get_varint(&p, end, &head))
+        {
+            return 0;
+        }
+        gap = head >> 3;
+        run = (head & 7) + 1;
+        if (run == 8)
+        {
+            if (!get_varint(&p, end, &run) || run > (unsigned int)n)
+            {
+                return 0;
+            }
+            run += 8;
+        }
+        if (gap > (unsigned int)n - at || run > (unsigned int)n - at - gap ||
+            run > (size_t)(end - p))
+        {
+            return 0;
+        }
+        at += gap;
+        memcpy(frame + at, p, run);
+        at += run;
+        p += run;
+    }
+    return 1;
+}
@@ -0,0 +1,44 @@
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* Frames and deltas of an ECL memory, shared by the timeline and mirroring.
+   A frame is mem, then state (one byte per cell), then vars; with wide values
+   on, then the value of every cell and of every var as a little-endian u32.
+   A delta lists
+   the runs of bytes that differ between two frames, each as a varint
+   gap << 3 | (length - 1), gap counting the unchanged bytes since the
+   previous run, followed by the new bytes. Runs of eight or more store 7 in
+   the low bits and length - 8 as a second varint. The size of a delta
+   scales with the number of changed cells, not with the size of the memory. */
+
+/* Bytes in a frame of ecl */
+int delta_frame_size(ecl_t *ecl);
+
+/* Bytes in a frame of memsz cells, with or without wide values */
+int delta_frame_bytes(int memsz, int wide);
+
+/* Copy the state of ecl into frame */
+void delta_capture(ecl_t *ecl, unsigned char *frame);
+
+/* Copy frame back into ecl; channels are cleared */
+void delta_restore(ecl_t *ecl, const unsigned char *frame);
+
+/* Largest delta between two frames of n bytes */
+size_t delta_bound(int n);
+
+/* Write the delta from prev to cur (n bytes each) into out, which must hold
+   delta_bound(n) bytes; returns the length of the delta, 0 when equal */
+size_t delta_encode(const unsigned char *prev, const unsigned char *cur, int n,
+                    unsigned char *out);
+
+/* Apply a delta of len bytes to a frame of n bytes; returns 0 when the delta
+   is malformed or runs past the frame, in which case frame is undefined */
+int delta_apply(unsigned char *frame, int n, const unsigned char *delta, size_t len);
+
+#endif
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "reference.h"
+
+/* Differential test: random programs built from the command vocabulary run
+   on the reference evaluator and on every candidate engine in lockstep, and
+   everything a program can observe is compared after each tick. The first
+   divergence is shrunk to a minimal grid and printed. New engines go in the
+   engines table; both evaluators also run with their columns split into
+   1:1 clock domains, against the reference without them. */
+
+#define PROGRAMS 400
+#define TICKS 64
+#define SEED 0x5eed
+
+typedef struct engine_t
+{
+  const char *name;
+  void (*eval)(ecl_t *ecl);
+} engine_t;
+
+/* Split the columns into clock domains at 1:1, which must change nothing */
+static void split(ecl_t *ecl)
+{
+  if (!ecl->nclocks && ecl->width > 1)
+  {
+    ecl_set_clock(ecl, 0, ecl->width / 2, ecl->width - ecl->width / 2, 1, 1);
+    if (ecl->width > 3)
+    {
+      ecl_set_clock(ecl, 1, 1, ecl->width / 2 - 1, 1, 1);
+    }
+  }
+}
+
+static void eval_clocked(ecl_t *ecl)
+{
+  split(ecl);
+  ecl_eval(ecl);
+}
+
+static void reference_clocked(ecl_t *ecl)
+{
+  split(ecl);
+  reference_eval(ecl);
+}
+
+static const engine_t engines[] = {
+    {"ecl_eval", ecl_eval},
+    {"ecl_eval with 1:1 clocks", eval_clocked},
+    {"reference_eval with 1:1 clocks", reference_clocked},
+};
+
+static unsigned long lcg;
+
+static int next(int n)
+{
+  lcg = lcg * 6364136223846793005UL + 1442695040888963407UL;
+  return (int)((lcg >> 33) % (unsigned long)n);
+}
+
+static void generate(char *grid, int n)
+{
+  const char *vocab = ecl_vocabulary();
+  const char *nums = "0123456789abcdefghijklmnopqrstuvwxyz";
+  int i, r;
+
+  for (i = 0; i < n; i++)
+  {
+    r = next(100);
+    grid[i] = r < 55 ? '.' : r < 75 ? vocab[next((int)strlen(vocab))]
+                           : r < 98 ? nums[next(r < 90 ? 10 : 36)]
+                                    : '?';
+  }
+}
+
+static const char *compare(ecl_t *a, ecl_t *b)
+{
+  const ecl_event_t *ea, *eb;
+  int na, nb;
+
+  if (a->clock != b->clock)
+  {
+    return "clock";
+  }
+  if (memcmp(a->mem, b->mem, a->memsz))
+  {
+    return "mem";
+  }
+  if (memcmp(a->state, b->state, a->memsz * sizeof(a->state[0])))
+  {
+    return "state";
+  }
+  if (memcmp(a->vars, b->vars, sizeof(a->vars)))
+  {
+    return "vars";
+  }
+  if (memcmp(a->channels, b->channels, sizeof(a->channels)))
+  {
+    return "channels";
+  }
+  ea = ecl_events(a, &na);
+  eb = ecl_events(b, &nb);
+  if (na != nb || (na && memcmp(ea, eb, na * sizeof(*ea))))
+  {
+    return "events";
+  }
+  return 0;
+}
+
+/* Run grid on the reference and engine; returns the first difference and
+   the tick it showed up in, or 0 when they agree */
+static const char *run(const engine_t *engine, const char *grid, int w, int h,
+                       unsigned long seed, int *tick)
+{
+  ecl_t *ref = ecl_new(w, h, seed);
+  ecl_t *cand = ecl_new(w, h, seed);
+  const char *diff = 0;
+  int i;
+
+  for (i = 0; i < w * h; i++)
+  {
+    ecl_set(ref, i, grid[i]);
+    ecl_set(cand, i, grid[i]);
+  }
+  for (*tick = 0; *tick < TICKS && !diff; (*tick)++)
+  {
+    reference_eval(ref);
+    engine->eval(cand);
+    diff = compare(ref, cand);
+  }
+  ecl_free(cand);
+  ecl_free(ref);
+  return diff;
+}
+
+/* Clear cells one at a time for as long as the programs still diverge */
+static void minimize(const engine_t *engine, char *grid, int w, int h, unsigned long seed)
+{
+  int i, tick, shrunk = 1;
+  char v;
+
+  while (shrunk)
+  {
+    shrunk = 0;
+    for (i = 0; i < w * h; i++)
+    {
+      if (grid[i] == '.')
+      {
+        continue;
+      }
+      v = grid[i];
+      grid[i] = '.';
+      if (run(engine, grid, w, h, seed, &tick))
+      {
+        shrunk = 1;
+      }
+      else
+      {
+        grid[i] = v;
+      }
+    }
+  }
+}
+
+static void print_grid(const char *grid, int w, int h)
+{
+  int x, y;
+
+  for (y = 0; y < h; y++)
+  {
+    for (x = 0; x < w; x++)
+    {
+      putchar(grid[x * h + y]);
+    }
+    putchar('\n');
+  }
+}
+
+int main(int argc, char **argv)
+{
+  char grid[32 * 32];
+  const char *diff;
+  unsigned long seed;
+  int p, e, w, h, tick, ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  lcg = SEED;
+  for (p = 0; p < PROGRAMS && ok; p++)
+  {
+    w = 1 + next(32);
+    h = 2 + next(31);
+    seed = (unsigned long)next(1 << 30);
+    generate(grid, w * h);
+    for (e = 0; e < (int)(sizeof(engines) / sizeof(engines[0])) && ok; e++)
+    {
+      diff = run(&engines[e], grid, w, h, seed, &tick);
+      if (diff)
+      {
+        minimize(&engines[e], grid, w, h, seed);
+        diff = run(&engines[e], grid, w, h, seed, &tick);
+        printf("diff: %s differs from the reference in %s at tick %d, program %d "
+               "(%dx%d, seed %lu), minimized:\n",
+               engines[e].name, diff, tick, p, w, h, seed);
+        print_grid(grid, w, h);
+        ok = 0;
+      }
+    }
+  }
+
+  printf("%s\n", ok ? "diff ok" : "diff FAILED");
+  return !ok;
+}
@@ -1,11 +1,74 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "rng.h"
 #include "ecl.h"
+#include "macro.h"
+
+#ifdef ECL_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#else
+#include <time.h>
+static unsigned long long cycles_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#define CYCLES() cycles_ns() /* nanoseconds where there is no TSC */
+#endif
+#endif
 
 #define BASE36 36
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Compiled cell roles kept in ecl->shape. The low bits hold the state a
+   cell always has while the program layout is unchanged (a command or one
+   of its arguments); zero means the state follows the cell value. */
+#define SHAPE_ROLE 0x0f
+#define SHAPE_KEY 0x10 /* writing here may change the layout, e.g. S length */
+
+/* The visual state of a cell is a byte: the top bit marks a cell that
+   fired in the last tick, then four bits of heat as of its last fire, in
+   sixteenths of the range of ecl_get_visual, then the half-life period it
+   fired in, modulo 8. Heat is decayed when read, halving each period, so
+   it is gone 4 periods on. Cells with a nonzero byte are listed in warm;
+   each tick clears the marks of those and drops the cold ones, before a
+   stamp could wrap, so the work follows activity rather than memory. */
+#define VISUAL_FIRED 0x80
+#define VISUAL_HEAT_SHIFT 3
+#define VISUAL_PERIOD 0x07
+#define VISUAL_MAX 15
+
+#define KIND_NUM 1
+#define KIND_CMD 2
+#define KIND_SPECIAL 4
+
+/* Lookup tables for cell values, filled once by tables_init. The arithmetic
+   tables take two values in [0, 35] and define the edge cases of each op:
+   ADD_SAT is a + b saturating at 35 (I), ADD_WRAP is (a + b) % 36 (A),
+   SUB_SAT is a - b floored at zero (D) and MOD is a % b with a % 0 == 0 (M). */
+static unsigned char KIND[256];     /* KIND_* bits of every byte */
+static unsigned char DECODE[256];   /* value of every byte; zero if not a number */
+static unsigned char STATE_OF[256]; /* state of a cell that is not a command or arg */
+static char ENCODE[BASE36 * 2];     /* glyph of v % 36 for v in [0, 72) */
+static unsigned char ADD_SAT[BASE36][BASE36];
+static unsigned char ADD_WRAP[BASE36][BASE36];
+static unsigned char SUB_SAT[BASE36][BASE36];
+static unsigned char MOD[BASE36][BASE36];
+
+static void tables_init(void);
+static void compile(ecl_t *ecl);
+static void pass(ecl_t *ecl, int lo, int hi);
 
 void ecl_reset(ecl_t *ecl)
 {
@@ -20,33 +83,337 @@ void ecl_reset(ecl_t *ecl)
         {
             ecl->vars[i] = '.';
         }
-        memset(ecl->state, 0, ecl->memsz);
+        memset(ecl->var_values, 0, sizeof(ecl->var_values));
+        memset(ecl->channels, 0, sizeof(ecl->channels));
+        memset(ecl->marks, 0, sizeof(ecl->marks));
+        ecl->nsent = 0;
+        memset(ecl->state, 0, ecl->memsz * sizeof(ecl->state[0]));
+        if (ecl->wide)
+        {
+            memset(ecl->wide, 0, ecl->memsz * sizeof(ecl->wide[0]));
+        }
+        memset(ecl->heat, 0, ecl->memsz);
+        ecl->nwarm = 0;
         ecl->clock = 0;
+        ecl->compiled = 0;
     }
 }
 
-ecl_t *ecl_new(int x, int y, unsigned long seed)
+/* Offsets of the parts of an instance placed in one block, each aligned
+   to ECL_ALIGN */
+typedef struct
+{
+    size_t rng, mem, state, shape, prog, heat, events, size;
+} layout_t;
+
+#define INITIAL_EVENTS 64
+
+static size_t align_up(size_t n)
+{
+    return (n + ECL_ALIGN - 1) & ~(size_t)(ECL_ALIGN - 1);
+}
+
+/* Lay out an instance of memsz cells; returns the size of the block. A
+   shared instance has no room for a program of its own. */
+static size_t layout(layout_t *l, size_t memsz, int shared)
+{
+    l->rng = align_up(sizeof(ecl_t));
+    l->mem = l->rng + align_up(rng_size());
+    l->state = l->mem + align_up(memsz * sizeof(char));
+    l->shape = l->state + align_up(memsz * sizeof(int));
+    l->prog = l->shape + (shared ? 0 : align_up(memsz * sizeof(unsigned char)));
+    l->heat = l->prog + (shared ? 0 : align_up(memsz * sizeof(ecl_instr_t)));
+    l->events = l->heat + align_up(memsz * sizeof(unsigned char));
+    l->size = l->events + align_up(INITIAL_EVENTS * sizeof(ecl_event_t));
+    return l->size;
+}
+
+size_t ecl_footprint(int x, int y)
 {
-    ecl_t *ecl = calloc(1, sizeof(ecl_t));
+    layout_t l;
+
+    if (x < 1 || y < 1 || x > INT_MAX / y)
+    {
+        return 0;
+    }
+    return layout(&l, (size_t)x * y, 0);
+}
+
+/* Set up an x by y instance in a block laid out by l */
+static ecl_t *place(char *p, const layout_t *l, int x, int y, unsigned long seed)
+{
+    ecl_t *ecl;
+
+    tables_init();
+    memset(p, 0, l->size);
+    ecl = (ecl_t *)p;
     ecl->width = x;
     ecl->height = y;
     ecl->memsz = ecl->width * ecl->height;
-    ecl->mem = calloc(ecl->memsz, sizeof(char));
-    ecl->state = calloc(ecl->memsz, sizeof(int));
-    ecl->rng = rng_new(seed);
+    ecl->capacity = ecl->memsz;
+    ecl->rng = rng_init(p + l->rng, seed);
+    ecl->mem = p + l->mem;
+    ecl->state = (int *)(p + l->state);
+    ecl->shape = (unsigned char *)(p + l->shape);
+    ecl->prog = (ecl_instr_t *)(p + l->prog); /* at most one per cell */
+    ecl->heat = (unsigned char *)(p + l->heat);
+    ecl->events = (ecl_event_t *)(p + l->events);
+    ecl->max_events = INITIAL_EVENTS;
     ecl_reset(ecl);
     return ecl;
 }
 
+ecl_t *ecl_new_in(void *block, size_t size, int x, int y, unsigned long seed)
+{
+    layout_t l;
+
+    if (!block || ((size_t)block & (ECL_ALIGN - 1)) ||
+        !ecl_footprint(x, y) || size < layout(&l, (size_t)x * y, 0))
+    {
+        return 0;
+    }
+    return place(block, &l, x, y, seed);
+}
+
+ecl_t *ecl_new(int x, int y, unsigned long seed)
+{
+    size_t size = ecl_footprint(x, y);
+    void *block;
+    ecl_t *ecl;
+
+    if (!size || posix_memalign(&block, ECL_ALIGN, size))
+    {
+        return 0;
+    }
+    ecl = ecl_new_in(block, size, x, y, seed);
+    ecl->owns = ECL_OWNS_BLOCK;
+    return ecl;
+}
+
+ecl_t *ecl_new_sharing(ecl_t *proto, unsigned long seed)
+{
+    layout_t l;
+    void *block;
+    ecl_t *ecl;
+
+    if (!proto || posix_memalign(&block, ECL_ALIGN, layout(&l, proto->memsz, 1)))
+    {
+        return 0;
+    }
+    ecl = place(block, &l, proto->width, proto->height, seed);
+    ecl->owns = ECL_OWNS_BLOCK | ECL_SHARES_PROG;
+    if (!proto->compiled)
+    {
+        compile(proto);
+    }
+    memcpy(ecl->mem, proto->mem, proto->memsz);
+    ecl->shape = proto->shape;
+    ecl->prog = proto->prog;
+    ecl->nprog = proto->nprog;
+    ecl->routes = proto->routes; /* its scratch is only used within a tick,
+                                    and one host runs its instances in turn */
+    ecl->nroutes = proto->nroutes;
+    ecl->compiled = 1;
+    return ecl;
+}
+
+/* Stop using the routes of the instance a program is shared with */
+static void unshare_routes(ecl_t *ecl)
+{
+    ecl->routes = 0;
+    ecl->nroutes = 0;
+    ecl->max_routes = 0;
+}
+
+/* Give an instance sharing a program its own, for compile to rebuild */
+static int unshare(ecl_t *ecl)
+{
+    unsigned char *shape = malloc(ecl->capacity * sizeof(unsigned char));
+    ecl_instr_t *prog = malloc(ecl->capacity * sizeof(ecl_instr_t));
+
+    if (!shape || !prog)
+    {
+        free(shape);
+        free(prog);
+        return 0;
+    }
+    ecl->shape = shape;
+    ecl->prog = prog;
+    unshare_routes(ecl);
+    ecl->owns = (ecl->owns & ~ECL_SHARES_PROG) | ECL_OWNS_PROG;
+    return 1;
+}
+
 void ecl_free(ecl_t *ecl)
 {
     if (ecl)
+    {
+        if (ecl->macros)
+        {
+            macro_free(ecl);
+        }
+        if (ecl->owns & ECL_OWNS_CELLS)
+        {
+            free(ecl->mem);
+            free(ecl->state);
+            free(ecl->shape);
+            free(ecl->prog);
+            free(ecl->heat);
+        }
+        else if (ecl->owns & ECL_OWNS_PROG)
+        {
+            free(ecl->shape);
+            free(ecl->prog);
+        }
+        if (ecl->owns & ECL_OWNS_EVENTS)
+        {
+            free(ecl->events);
+        }
+        if (!(ecl->owns & ECL_SHARES_PROG))
+        {
+            free(ecl->routes); /* always on the heap */
+        }
+        free(ecl->wide);
+        free(ecl->warm);
+        if (ecl->owns & ECL_OWNS_BLOCK)
+        {
+            free(ecl);
+        }
+    }
+}
+
+/* Move the per-cell arrays to the heap with room for cap cells, keeping the
+   first memsz of each; all or nothing */
+static int regrow(ecl_t *ecl, int cap)
+{
+    char *mem = malloc(cap * sizeof(char));
+    int *state = malloc(cap * sizeof(int));
+    unsigned char *shape = malloc(cap * sizeof(unsigned char));
+    ecl_instr_t *prog = malloc(cap * sizeof(ecl_instr_t));
+    unsigned char *heat = malloc(cap * sizeof(unsigned char));
+
+    if (!mem || !state || !shape || !prog || !heat)
+    {
+        free(mem);
+        free(state);
+        free(shape);
+        free(prog);
+        free(heat);
+        return 0;
+    }
+    /* shape and prog are rebuilt by the next compile */
+    memcpy(mem, ecl->mem, ecl->memsz * sizeof(char));
+    memcpy(state, ecl->state, ecl->memsz * sizeof(int));
+    memcpy(heat, ecl->heat, ecl->memsz * sizeof(unsigned char));
+    if (ecl->owns & ECL_OWNS_CELLS)
     {
         free(ecl->mem);
         free(ecl->state);
-        rng_free(ecl->rng);
-        free(ecl);
+        free(ecl->shape);
+        free(ecl->prog);
+        free(ecl->heat);
+    }
+    else if (ecl->owns & ECL_OWNS_PROG)
+    {
+        free(ecl->shape);
+        free(ecl->prog);
+    }
+    if (ecl->owns & ECL_SHARES_PROG)
+    {
+        unshare_routes(ecl);
+    }
+    ecl->mem = mem;
+    ecl->state = state;
+    ecl->shape = shape;
+    ecl->prog = prog;
+    ecl->heat = heat;
+    ecl->capacity = cap;
+    ecl->owns = (ecl->owns | ECL_OWNS_CELLS) & ~(ECL_SHARES_PROG | ECL_OWNS_PROG);
+    ecl->compiled = 0;
+    return 1;
+}
+
+/* Move a grid of w0 columns of h0 elements of size bytes to w1 columns of
+   h1 in place, keeping each element at its column and row and setting new
+   ones to fill */
+static void relayout(void *buf, size_t size, int w0, int h0, int w1, int h1, const void *fill)
+{
+    char *p = buf;
+    int w = w0 < w1 ? w0 : w1, h = h0 < h1 ? h0 : h1, c, r;
+
+    if (h1 > h0)
+    { /* columns move up; start with the last so none is overwritten */
+        for (c = w - 1; c > 0; c--)
+        {
+            memmove(p + (size_t)c * h1 * size, p + (size_t)c * h0 * size, (size_t)h * size);
+        }
+    }
+    else if (h1 < h0)
+    {
+        for (c = 1; c < w; c++)
+        {
+            memmove(p + (size_t)c * h1 * size, p + (size_t)c * h0 * size, (size_t)h * size);
+        }
+    }
+    for (c = 0; c < w1; c++)
+    {
+        for (r = (c < w) ? h : 0; r < h1; r++)
+        {
+            memcpy(p + ((size_t)c * h1 + r) * size, fill, size);
+        }
+    }
+}
+
+int ecl_resize(ecl_t *ecl, int w, int h)
+{
+    static const char empty = '.';
+    static const int zero = 0;
+    int need, cap, *wide, i, n, col, row;
+
+    if (!ecl || w < 1 || h < 1 || w > INT_MAX / h)
+    {
+        return 0;
+    }
+    need = w * h;
+    if (need > ecl->capacity)
+    { /* grow geometrically so repeated resizes amortize */
+        cap = (ecl->capacity <= INT_MAX / 2 && ecl->capacity * 2 > need) ? ecl->capacity * 2 : need;
+        if (ecl->wide)
+        { /* grown first; a bigger wide array does no harm if regrow fails */
+            wide = realloc(ecl->wide, cap * sizeof(int));
+            if (!wide)
+            {
+                return 0;
+            }
+            ecl->wide = wide;
+        }
+        if (!regrow(ecl, cap))
+        {
+            return 0;
+        }
+    }
+    if (ecl->wide)
+    {
+        relayout(ecl->wide, sizeof(int), ecl->width, ecl->height, w, h, &zero);
+    }
+    relayout(ecl->mem, sizeof(char), ecl->width, ecl->height, w, h, &empty);
+    relayout(ecl->state, sizeof(int), ecl->width, ecl->height, w, h, &zero);
+    relayout(ecl->heat, sizeof(unsigned char), ecl->width, ecl->height, w, h, &zero);
+    for (i = n = 0; i < ecl->nwarm; i++)
+    { /* warm cells move with their column and row */
+        col = ecl->warm[i] / ecl->height;
+        row = ecl->warm[i] % ecl->height;
+        if (col < w && row < h)
+        {
+            ecl->warm[n++] = col * h + row;
+        }
     }
+    ecl->nwarm = n;
+    ecl->width = w;
+    ecl->height = h;
+    ecl->memsz = need;
+    ecl->compiled = 0;
+    return 1;
 }
 
 void ecl_set_output(ecl_t *ecl,
@@ -57,54 +424,142 @@ void ecl_set_output(ecl_t *ecl,
     ecl->output_ctx = ctx;
 }
 
-int char2int(char c)
+void ecl_set_output_batch(ecl_t *ecl,
+                          void (*batch_fn)(const ecl_event_t *events, int count, int tick, void *ctx),
+                          void *ctx)
+{
+    ecl->batch_fn = batch_fn;
+    ecl->batch_ctx = ctx;
+}
+
+const ecl_event_t *ecl_events(ecl_t *ecl, int *count)
 {
-    if (c == '.')
+    if (count)
     {
-        return 0;
+        *count = ecl ? ecl->nevents : 0;
+    }
+    return ecl ? ecl->events : 0;
+}
+
+const ecl_stats_t *ecl_stats(ecl_t *ecl)
+{
+    return ecl ? &ecl->stats : 0;
+}
+
+void ecl_stats_reset(ecl_t *ecl)
+{
+    if (ecl)
+    {
+        memset(&ecl->stats, 0, sizeof(ecl->stats));
     }
-    else if ((c >= '0') && (c <= '9'))
+}
+
+void ecl_stats_dump(ecl_t *ecl, FILE *file)
+{
+    const ecl_stats_t *s;
+    int order[128], n = 0, i, j, c;
+
+    if (!ecl || !file)
     {
-        return c - '0';
+        return;
+    }
+    s = &ecl->stats;
+    fprintf(file, "tick %d: %lu ticks, %lu moved, %lu deleted, %lu teleports, %lu events\n",
+            ecl->clock, s->ticks, s->moved, s->deleted, s->teleports, s->events);
+    for (c = 0; c < 128; c++)
+    { /* insertion sort by cycles, then fires */
+        if (!s->fires[c])
+        {
+            continue;
+        }
+        for (i = n++; i > 0; i--)
+        {
+            j = order[i - 1];
+            if (s->cycles[j] > s->cycles[c] ||
+                (s->cycles[j] == s->cycles[c] && s->fires[j] >= s->fires[c]))
+            {
+                break;
+            }
+            order[i] = j;
+        }
+        order[i] = c;
     }
-    else if ((c >= 'a') && (c <= 'z'))
+    for (i = 0; i < n; i++)
     {
-        return c - 'a' + 10;
+        c = order[i];
+        fprintf(file, "  %c %10lu fires", c, s->fires[c]);
+#ifdef ECL_PROFILE
+        fprintf(file, " %14llu cycles %8llu/fire", s->cycles[c], s->cycles[c] / s->fires[c]);
+#endif
+        fprintf(file, "\n");
     }
-    return 0;
 }
 
-char int2char(int v)
+void ecl_stats_every(ecl_t *ecl, int n, FILE *file)
 {
-    v %= BASE36; /* modulo, sice we are in base 36 */
-    if (v < 0)
+    if (ecl)
     {
-        v *= -1; /* positive only */
+        ecl->stats_every = (n > 0 && file) ? n : 0;
+        ecl->stats_file = file;
     }
-    if (v >= 0 && v <= 9)
+}
+
+/* Deliver the events of the tick just evaluated */
+static void flush_events(ecl_t *ecl)
+{
+    int i;
+    ecl_event_t *e;
+
+    if (ecl->nevents == 0)
     {
-        return '0' + v;
+        return;
     }
-    else
+    if (ecl->batch_fn)
+    {
+        ecl->batch_fn(ecl->events, ecl->nevents, ecl->clock, ecl->batch_ctx);
+    }
+    if (ecl->output_fn)
+    {
+        for (i = 0; i < ecl->nevents; i++)
+        {
+            e = &ecl->events[i];
+            ecl->output_fn(e->channel, e->note, e->octave, e->velocity, e->length, ecl->output_ctx);
+        }
+    }
+}
+
+int char2int(char c)
+{
+    return DECODE[(unsigned char)c];
+}
+
+char int2char(int v)
+{
+    if ((unsigned int)v < BASE36 * 2)
+    { /* every op result is a sum of at most two digits */
+        return ENCODE[v];
+    }
+    v %= BASE36; /* modulo, sice we are in base 36 */
+    if (v < 0)
     {
-        return 'a' + (v - 10);
+        v *= -1; /* positive only */
     }
+    return ENCODE[v];
 }
 
 int is_number(char c)
 {
-    return (((c >= '0') && (c <= '9')) ||
-            ((c >= 'a') && (c <= 'z')));
+    return KIND[(unsigned char)c] & KIND_NUM;
 }
 
 int is_command(char c)
 {
-    return (c >= 'A' && c <= 'Z') || c == '<' || c == '>' || c == '$';
+    return KIND[(unsigned char)c] & KIND_CMD;
 }
 
 int is_special(char c)
 {
-    return c == '?';
+    return KIND[(unsigned char)c] & KIND_SPECIAL;
 }
 
 int is_empty(int c)
@@ -114,7 +569,7 @@ int is_empty(int c)
 
 int valid_char(char c)
 {
-    return is_number(c) || is_command(c) || is_special(c);
+    return KIND[(unsigned char)c] != 0;
 }
 
 /* Get the value at memory position x */
@@ -122,6 +577,10 @@ char ecl_get(ecl_t *ecl, int x)
 {
     if (ecl)
     {
+        if ((unsigned int)x < (unsigned int)ecl->memsz)
+        { /* interior cells need no wrapping */
+            return ecl->mem[x];
+        }
         x = abs(x);
         return ecl->mem[x % ecl->memsz];
     }
@@ -133,155 +592,446 @@ int ecl_get_state(ecl_t *ecl, int x)
 {
     if (ecl)
     {
+        if ((unsigned int)x < (unsigned int)ecl->memsz)
+        {
+            return ecl->state[x];
+        }
         x = abs(x);
         return ecl->state[x % ecl->memsz];
     }
     return STATE_ERR;
 }
 
-void ecl_set(ecl_t *ecl, int x, char val)
+/* Half-life period of tick t */
+static int period(int t)
 {
-    if (ecl)
+    return (int)((unsigned int)t / ECL_VISUAL_HALF_LIFE);
+}
+
+/* Heat of the cell at x at tick now, 0 to VISUAL_MAX */
+static int decayed(ecl_t *ecl, int x, int now)
+{
+    int v = ecl->heat[x], age = (period(now) - v) & VISUAL_PERIOD;
+
+    return ((v >> VISUAL_HEAT_SHIFT) & VISUAL_MAX) >> age;
+}
+
+int ecl_get_visual(ecl_t *ecl, int x)
+{
+    if (!ecl)
     {
-        //printf("inserting in ecl %d val %c\n", x, val);
-        ecl->mem[x % ecl->memsz] = valid_char(val) ? val : '.';
+        return 0;
     }
+    x = abs(x) % ecl->memsz;
+    return decayed(ecl, x, ecl->clock - 1) * (255 / VISUAL_MAX);
 }
 
-/* Set the state at memory position x */
-void ecl_set_state(ecl_t *ecl, int x, int val)
+int ecl_get_fired(ecl_t *ecl, int x)
 {
-    if (ecl)
+    int now;
+
+    if (!ecl)
+    {
+        return -1;
+    }
+    x = abs(x) % ecl->memsz;
+    now = ecl->clock - 1;
+    if (ecl->heat[x] & VISUAL_FIRED)
+    {
+        return now;
+    }
+    if (!decayed(ecl, x, now))
     {
-        ecl->state[x % ecl->memsz] = val;
+        return -1;
     }
+    return (period(now) - ((period(now) - ecl->heat[x]) & VISUAL_PERIOD)) * ECL_VISUAL_HALF_LIFE;
 }
 
-/* Dump memory to stdout */
-void ecl_dump(ecl_t *ecl)
+/* Record that the cell at x fired in the current tick */
+static void visual_fire(ecl_t *ecl, int x)
 {
-    int x;
-    if (ecl)
-    {
-        printf("0123456789abcdef\n");
-        for (x = 0; x < ecl->memsz; x++)
+    int heat, *warm;
+
+    if (!ecl->heat[x])
+    { /* listed on its first fire; without room it goes unseen */
+        if (ecl->nwarm == ecl->max_warm)
         {
-            printf("%c", ecl->mem[x]);
+            warm = realloc(ecl->warm, (ecl->max_warm ? ecl->max_warm * 2 : 64) * sizeof(int));
+            if (!warm)
+            {
+                return;
+            }
+            ecl->warm = warm;
+            ecl->max_warm = ecl->max_warm ? ecl->max_warm * 2 : 64;
         }
-        printf("\n\n");
+        ecl->warm[ecl->nwarm++] = x;
     }
+    heat = MIN(decayed(ecl, x, ecl->clock) + ECL_VISUAL_FIRE / 16, VISUAL_MAX);
+    ecl->heat[x] = (unsigned char)(VISUAL_FIRED | heat << VISUAL_HEAT_SHIFT |
+                                   (period(ecl->clock) & VISUAL_PERIOD));
 }
 
-typedef struct
+/* Clear the marks of the last tick and forget cells that went cold */
+static void visual_decay(ecl_t *ecl)
 {
-    char cmd;
-    int pure,    /* always bangs, no bang input required */
-        varargs, /* argument length specifed by first argument */
-        bangs,   /* number of inputs required for a bang event; default value if varbangs true */
-        args;    /* arg counts */
-} arg_t;
-
-arg_t ARGS[] = {
-    /* Ideas: 
-    Accumulate (or decrease) values in a register
-    Conditional: Jump if register is zero
-    Unnamed counter/decrementer 
-    */
-
-    {'A', 0, 0, 1, 1}, /* accumulate values; argument is register storage */
-    // Burst
-    {'C', 0, 0, 1, 1}, /* produce a constant value on bang */
-    {'D', 0, 0, 1, 1}, /* decrement value of bang by arg (def 1) on output */
-    {'E', 0, 0, 1, 3}, /* Eucliden clock, args: pulses, steps, current */
-    {'F', 0, 0, 1, 1}, /* if bang value matches argument, allow value to pass otherwise block */
-    {'G', 1, 0, 0, 2}, /* pure generator;  pure creators of bangs, args: rate, max */
-    // H
-    {'I', 0, 0, 1, 1}, /* increment value of bang by arg (def 1) on output */
-    {'J', 0, 0, 1, 1}, /* jump bang value a specified number of cells  */
-    // K
-    // L   limit?
-    {'M', 0, 0, 1, 1}, /* mod; bang with x, arg is y, output x%y */
-    // N
-    {'O', 0, 0, 1, 5}, /* Output to a device (midi); channel, octave, note, velocity, length */  
-    // Add repeat to output?
-    {'P', 0, 0, 1, 1}, /* continue bang probabilistically */
-    {'Q', 0, 0, 1, 1}, /* query a register on bang */
-    {'R', 0, 0, 1, 2}, /* randomize; no args -> binary */
-    {'S', 0, 1, 1, 1}, /* store a specified length (sequence) of numbers */
-    {'T', 0, 0, 1, 1}, /* teleport a bang to a channel */
-    // U
-    {'V', 0, 0, 1, 2}, /* Store bang value into a named register */
-    // W
-    {'X', 0, 0, 1, 0}, /* Kill a bang */
-    // Y
-    // Z
-    {'Z', 0, 0, 1, 1}, /* Jump unless zero to address specified  */
-    {'O', 0, 0, 1, 5}, /* output to midi; channel, octave, note, velocity, length */
-    {'<', 0, 0, 1, 1}, /* redirect to left n cols */
-    {'>', 0, 0, 1, 1}, /* redirect to right n cols */
-    {'$', 0, 0, 1, 1}, /* duplicate bang value with optional offset */
-    {0, 0, 0, 0, 0},
-};
+    int i, n = 0, x;
 
-/* TODO: optimize this with generated tables that use 127 value table */
-arg_t *find_arg(char c)
-{
-    int i;
-    for (i = 0; ARGS[i].cmd; i++)
+    for (i = 0; i < ecl->nwarm; i++)
     {
-        if (c == ARGS[i].cmd)
+        x = ecl->warm[i];
+        ecl->heat[x] &= ~VISUAL_FIRED;
+        if (decayed(ecl, x, ecl->clock))
+        {
+            ecl->warm[n++] = x;
+        }
+        else
         {
-            return &ARGS[i];
+            ecl->heat[x] = 0;
         }
     }
-    return 0;
+    ecl->nwarm = n;
 }
 
-int can_bang(ecl_t *ecl, int x, int req)
+void ecl_set(ecl_t *ecl, int x, char val)
 {
-    int i;
-    for (i = 1; i <= req; i++)
+    char *cell;
+
+    if (ecl)
     {
-        if (ecl_get_state(ecl, x - i) != STATE_NUM)
+        if ((unsigned int)x >= (unsigned int)ecl->memsz)
+        { /* wrap like ecl_get, negative addresses included */
+            x = abs(x) % ecl->memsz;
+        }
+        cell = &ecl->mem[x];
+        val = valid_char(val) ? val : '.';
+        /* only commands and layout keys change the compiled program */
+        if (*cell != val &&
+            (is_command(*cell) || is_command(val) || (ecl->shape[x] & SHAPE_KEY)))
         {
-            return 0;
+            ecl->compiled = 0;
+        }
+        *cell = val;
+        if (ecl->wide)
+        {
+            ecl->wide[x] = DECODE[(unsigned char)val];
         }
     }
-    return 1;
 }
 
-static void op_teleport_read(ecl_t *ecl, int x)
+/* Wrap an address like ecl_get and ecl_set */
+static int wrap(ecl_t *ecl, int x)
 {
-    char bang = ecl_get(ecl, x - 1);
-    char arg = ecl_get(ecl, x + 1);
+    return (unsigned int)x < (unsigned int)ecl->memsz ? x : abs(x) % ecl->memsz;
+}
+
+int ecl_set_wide(ecl_t *ecl, int on)
+{
+    int i;
+
+    if (!ecl)
+    {
+        return 0;
+    }
+    if (!on)
+    {
+        free(ecl->wide);
+        ecl->wide = 0;
+    }
+    else if (!ecl->wide)
+    {
+        ecl->wide = malloc(ecl->capacity * sizeof(int));
+        if (!ecl->wide)
+        {
+            return 0;
+        }
+        for (i = 0; i < ecl->memsz; i++)
+        {
+            ecl->wide[i] = DECODE[(unsigned char)ecl->mem[i]];
+        }
+        for (i = 0; i < BASE36; i++)
+        {
+            ecl->var_values[i] = DECODE[(unsigned char)ecl->vars[i]];
+        }
+    }
+    return 1;
+}
+
+int ecl_set_clock(ecl_t *ecl, int id, int col, int cols, int mul, int div)
+{
+    ecl_clock_t *c;
+    int i;
+
+    if (!ecl || id < 0 || id >= ECL_CLOCKS || col < 0 || cols < 0 || mul < 1 || div < 1)
+    {
+        return 0;
+    }
+    for (i = 0; i < ECL_CLOCKS && cols > 0; i++)
+    {
+        c = &ecl->clocks[i];
+        if (i != id && c->cols > 0 && col < c->col + c->cols && c->col < col + cols)
+        {
+            return 0;
+        }
+    }
+    c = &ecl->clocks[id];
+    c->col = col;
+    c->cols = cols;
+    c->mul = mul;
+    c->div = div;
+    for (i = 0, ecl->nclocks = 0; i < ECL_CLOCKS; i++)
+    {
+        ecl->nclocks += ecl->clocks[i].cols > 0;
+    }
+    return 1;
+}
+
+int ecl_clock_spec(ecl_t *ecl, const char *spec)
+{
+    int id, col, cols, mul, div = 1;
+
+    if (sscanf(spec, "%d=%d,%d,%d/%d", &id, &col, &cols, &mul, &div) < 4)
+    {
+        return 0;
+    }
+    return ecl_set_clock(ecl, id, col, cols, mul, div);
+}
+
+int ecl_get_num(ecl_t *ecl, int x)
+{
+    if (!ecl)
+    {
+        return 0;
+    }
+    x = wrap(ecl, x);
+    return ecl->wide ? ecl->wide[x] : DECODE[(unsigned char)ecl->mem[x]];
+}
+
+void ecl_set_num(ecl_t *ecl, int x, int v)
+{
+    ecl_set(ecl, x, int2char(v));
+    if (ecl && ecl->wide)
+    {
+        ecl->wide[wrap(ecl, x)] = v;
+    }
+}
+
+/* Write glyph c at x with wide value v: a number copied from elsewhere,
+   which keeps its value in full */
+static void set_copy(ecl_t *ecl, int x, char c, int v)
+{
+    ecl_set(ecl, x, c);
+    if (ecl->wide)
+    {
+        ecl->wide[wrap(ecl, x)] = v;
+    }
+}
+
+/* Move or copy the number at from to to */
+static void copy_num(ecl_t *ecl, int to, int from)
+{
+    set_copy(ecl, to, ecl_get(ecl, from), ecl->wide ? ecl->wide[wrap(ecl, from)] : 0);
+}
+
+/* A distance of at least one, reduced below memsz + 1 without changing
+   the cell it lands on, so wide distances cannot overflow an address */
+static int span(ecl_t *ecl, int d)
+{
+    return d > ecl->memsz ? (d - 1) % ecl->memsz + 1 : d;
+}
+
+void ecl_invalidate(ecl_t *ecl)
+{
+    if (ecl)
+    {
+        ecl->compiled = 0;
+    }
+}
+
+/* Set the state at memory position x */
+void ecl_set_state(ecl_t *ecl, int x, int val)
+{
+    if (ecl)
+    {
+        if ((unsigned int)x >= (unsigned int)ecl->memsz)
+        {
+            x = abs(x) % ecl->memsz;
+        }
+        ecl->state[x] = val;
+    }
+}
+
+/* Dump memory to stdout */
+void ecl_dump(ecl_t *ecl)
+{
+    int x;
+    if (ecl)
+    {
+        printf("0123456789abcdef\n");
+        for (x = 0; x < ecl->memsz; x++)
+        {
+            printf("%c", ecl->mem[x]);
+        }
+        printf("\n\n");
+    }
+}
+
+int can_bang(ecl_t *ecl, int x, int req)
+{
+    int i;
+    for (i = 1; i <= req; i++)
+    {
+        if (ecl_get_state(ecl, x - i) != STATE_NUM)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Write value v to channel c; it reaches the receivers after the tick */
+static void send(ecl_t *ecl, int c, int v)
+{
+    if (!(ecl->marks[c >> 3] & 1 << (c & 7)))
+    {
+        ecl->marks[c >> 3] |= (unsigned char)(1 << (c & 7));
+        ecl->sent[ecl->nsent++] = (short)c;
+    }
+    ecl->channels[c] = v;
+}
+
+static void op_teleport_read(ecl_t *ecl, int x)
+{
+    char arg = ecl_get(ecl, x + 1);
     int v = (arg == '?') ? 0 : char2int(arg); /* prevent ? args */
-    ecl->channels[v] = char2int(bang);
+    send(ecl, v, ecl_get_num(ecl, x - 1));
     printf("setting var(%d) = %d\n", v, ecl->channels[v]);
 }
 
+/* Teleport on a two digit channel; U0a and Ta share a channel */
+static void op_teleport_wide(ecl_t *ecl, int x)
+{
+    int v = char2int(ecl_get(ecl, x + 1)) * BASE36 + char2int(ecl_get(ecl, x + 2));
+    send(ecl, v, ecl_get_num(ecl, x - 1));
+}
+
+/* Channel the T or U cell at x listens on and the cell it writes to; -1
+   if x holds neither */
+static int route(ecl_t *ecl, int x, int *out)
+{
+    switch (ecl->mem[x])
+    {
+    case 'T':
+        *out = (x + 2) % ecl->memsz;
+        return char2int(ecl_get(ecl, x + 1));
+    case 'U':
+        *out = (x + 3) % ecl->memsz;
+        return char2int(ecl_get(ecl, x + 1)) * BASE36 + char2int(ecl_get(ecl, x + 2));
+    default:
+        return -1;
+    }
+}
+
+/* Hand the receiver at x its channel value if the channel was written;
+   returns the cell written, or -1 */
+static int deliver(ecl_t *ecl, int x)
+{
+    int out, c = route(ecl, x, &out);
+
+    if (c < 0 || ecl->channels[c] <= 0)
+    {
+        return -1;
+    }
+    ecl_set_num(ecl, out, ecl->channels[c]);
+    ecl_set_state(ecl, out, STATE_NUM);
+    ecl->stats.teleports++;
+    return out;
+}
+
+/* Empty the channels written this tick */
+static void clear_channels(ecl_t *ecl)
+{
+    int i;
+
+    for (i = 0; i < ecl->nsent; i++)
+    {
+        ecl->channels[ecl->sent[i]] = 0;
+        ecl->marks[ecl->sent[i] >> 3] = 0;
+    }
+    ecl->nsent = 0;
+}
+
+/* Deliver by visiting every cell from x on */
+static void deliver_from(ecl_t *ecl, int x)
+{
+    for (; x < ecl->memsz; x++)
+    {
+        deliver(ecl, x);
+    }
+}
+
+/* Teleport by a full scan; for when there is no receiver index */
+static void do_teleport_scan(ecl_t *ecl)
+{
+    if (ecl->nsent > 0)
+    {
+        deliver_from(ecl, 0);
+    }
+    clear_channels(ecl);
+}
+
+static int by_address(const void *a, const void *b)
+{
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Deliver the channels written this tick using the receiver index: only
+   receivers of those channels are visited, in address order as a scan
+   would. Deliveries are numbers, so they never make a receiver, but one
+   may land on the channel digit of a later receiver; the rest is then
+   scanned so that receiver sees its new channel, as it would in a scan. */
 static void do_teleport(ecl_t *ecl)
 {
-    int x;
-    int arg;
-    char v;
+    int i, k, c, n = 0, out, *first, *cells, *found;
 
-    for (x = 0; x < ecl->memsz; x++)
+    if (ecl->nsent == 0)
     {
-        v = ecl->mem[x];
-        if (v == 'T')
+        return;
+    }
+    if (!ecl->compiled)
+    { /* a command or channel digit was written this tick */
+        compile(ecl);
+    }
+    if (!ecl->routes)
+    {
+        do_teleport_scan(ecl);
+        return;
+    }
+    first = ecl->routes;
+    cells = first + ECL_CHANNELS + 1;
+    found = cells + ecl->nroutes;
+    for (i = 0; i < ecl->nsent; i++)
+    {
+        c = ecl->sent[i];
+        for (k = first[c]; k < first[c + 1] && ecl->channels[c] > 0; k++)
         {
-            arg = char2int(ecl_get(ecl, x + 1));
-            if (ecl->channels[arg] > 0)
-            {
-                ecl_set(ecl, x + 2, int2char(ecl->channels[arg]));
-                ecl_set_state(ecl, x + 2, STATE_NUM);
-            }
+            found[n++] = cells[k];
         }
     }
-    for (x = 0; x < BASE36; x++)
+    if (ecl->nsent > 1)
+    {
+        qsort(found, n, sizeof(int), by_address);
+    }
+    for (i = 0; i < n; i++)
     {
-        ecl->channels[x] = 0;
+        out = deliver(ecl, found[i]);
+        if (out >= 0 && (ecl->shape[out] & SHAPE_KEY))
+        {
+            deliver_from(ecl, found[i] + 1);
+            break;
+        }
     }
+    clear_channels(ecl);
 }
 
 /* Write bang to an address at X,Y (X*WIDTH+Y) offset from v */
@@ -308,10 +1058,10 @@ static void op_prob(ecl_t *ecl, int x)
 
     arg = ecl_get(ecl, x + 1);
     bang = ecl_get(ecl, x - 1);
-    v = char2int((arg == '?') ? bang : arg);
+    v = ecl_get_num(ecl, (arg == '?') ? x - 1 : x + 1);
     if (v > 0) /* value of zero does not pass */
     {
-        if (v == BASE36 - 1) /* max value */
+        if (v >= BASE36 - 1) /* max value */
         {
             pass = 1;
         }
@@ -322,16 +1072,15 @@ static void op_prob(ecl_t *ecl, int x)
     } /* else block bang, default with arg of 0 or empty */
     if (pass)
     {
-        x += 2;
-        ecl_set(ecl, x, bang);
-        ecl_set_state(ecl, x, STATE_NUM);
+        set_copy(ecl, x + 2, bang, ecl_get_num(ecl, x - 1));
+        ecl_set_state(ecl, x + 2, STATE_NUM);
     }
 }
 
 static void op_inc(ecl_t *ecl, int x)
 {
     int v = 1;
-    int bang = char2int(ecl_get(ecl, x - 1));
+    int bang = ecl_get_num(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
 
     if (arg == '?')
@@ -342,23 +1091,26 @@ static void op_inc(ecl_t *ecl, int x)
     {
         if (!is_empty(arg))
         {
-            v = char2int(arg);
+            v = ecl_get_num(ecl, x + 1);
         }
     }
-    v += bang;
-    if (v > BASE36 - 1)
+    if (ecl->wide)
+    {
+        v = (bang > ECL_WIDE_MAX - v) ? ECL_WIDE_MAX : bang + v;
+    }
+    else
     {
-        v = BASE36 - 1;
+        v = ADD_SAT[bang][v];
     }
     x += 2;
-    ecl_set(ecl, x, int2char(v));
+    ecl_set_num(ecl, x, v);
     ecl_set_state(ecl, x, STATE_NUM);
 }
 
 static void op_dec(ecl_t *ecl, int x)
 {
     int v = 1;
-    int bang = char2int(ecl_get(ecl, x - 1));
+    int bang = ecl_get_num(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
 
     if (arg == '?')
@@ -369,36 +1121,40 @@ static void op_dec(ecl_t *ecl, int x)
     {
         if (!is_empty(arg))
         {
-            v = char2int(arg);
+            v = ecl_get_num(ecl, x + 1);
         }
     }
-    v = bang - v;
-    if (v < 0) /* lower bound at zero */
-    {
-        v = 0;
-    }
+    v = ecl->wide ? (bang > v ? bang - v : 0) : SUB_SAT[bang][v]; /* lower bound at zero */
     x += 2;
-    ecl_set(ecl, x, int2char(v));
+    ecl_set_num(ecl, x, v);
     ecl_set_state(ecl, x, STATE_NUM);
 }
 
 /* To reset accumulator, just use Z8..J7.....A0... */
 static void op_accumulate(ecl_t *ecl, int x)
 {
-    char bang = ecl_get(ecl, x - 1);
-    char arg = ecl_get(ecl, x + 1);
-    int sum = char2int(arg) + char2int(bang);
+    int bang = ecl_get_num(ecl, x - 1);
+    int arg = ecl_get_num(ecl, x + 1);
+    int sum;
 
-    if (char2int(bang) > 0)
+    if (ecl->wide)
+    { /* wraps at the wide limit as the digits wrap at 36 */
+        sum = (int)(((unsigned int)arg + (unsigned int)bang) & ECL_WIDE_MAX);
+    }
+    else
+    {
+        sum = ADD_WRAP[arg][bang];
+    }
+    if (bang > 0)
     {
 
         /* write accumulated value to register */
         x += 1;
-        ecl_set(ecl, x, int2char(sum));
+        ecl_set_num(ecl, x, sum);
         ecl_set_state(ecl, x, STATE_ARG);
         /* then to ouput */
         x += 1;
-        ecl_set(ecl, x, int2char(sum));
+        ecl_set_num(ecl, x, sum);
         ecl_set_state(ecl, x, STATE_NUM);
     }
 }
@@ -407,12 +1163,13 @@ static void op_if(ecl_t *ecl, int x)
 {
     char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    
-    if (arg == bang)
+    int v = ecl_get_num(ecl, x - 1);
+
+    /* wide numbers match by value; equal glyphs may hold different ones */
+    if ((ecl->wide && is_number(arg) && is_number(bang)) ? ecl_get_num(ecl, x + 1) == v : arg == bang)
     {
-        x += 2;
-        ecl_set(ecl, x, bang);
-        ecl_set_state(ecl, x, STATE_NUM);
+        set_copy(ecl, x + 2, bang, v);
+        ecl_set_state(ecl, x + 2, STATE_NUM);
     }
 }
 
@@ -421,20 +1178,18 @@ of ? will make this an identity function where bang value equals output
 value */
 static void op_const(ecl_t *ecl, int x)
 {
-    char bang, arg = ecl_get(ecl, x + 1);
+    char arg = ecl_get(ecl, x + 1);
     if (!is_empty(arg))
     {
-        x += 2;
         if (arg == '?')
         {
-            bang = ecl_get(ecl, x - 3);
-            ecl_set(ecl, x, bang);
+            copy_num(ecl, x + 2, x - 1);
         }
         else
         { /* standard value as arg */
-            ecl_set(ecl, x, arg);
+            copy_num(ecl, x + 2, x + 1);
         }
-        ecl_set_state(ecl, x, STATE_NUM);
+        ecl_set_state(ecl, x + 2, STATE_NUM);
     }
 }
 
@@ -442,41 +1197,40 @@ static void op_const(ecl_t *ecl, int x)
 static void op_rand(ecl_t *ecl, int x)
 {
     int v, min, max;
-    char bang, min_arg, max_arg;
+    char min_arg, max_arg;
 
     min_arg = ecl_get(ecl, x + 1);
     max_arg = ecl_get(ecl, x + 2);
-    bang = ecl_get(ecl, x - 1);
-    min = char2int((min_arg == '?') ? bang : min_arg);
-    max = char2int((max_arg == '?') ? bang : max_arg) + 1;
+    min = ecl_get_num(ecl, (min_arg == '?') ? x - 1 : x + 1);
+    max = ecl_get_num(ecl, (max_arg == '?') ? x - 1 : x + 2);
+    max += max < ECL_WIDE_MAX;
 
     if (max <= min)
     {
-        max = min + 2;
+        max = (min < ECL_WIDE_MAX - 1) ? min + 2 : ECL_WIDE_MAX;
     }
     printf("min %d max %d\n", min, max);
     v = rng_double(ecl->rng) * (max - min) + min;
     x += 3;
-    ecl_set(ecl, x, int2char(v));
+    ecl_set_num(ecl, x, v);
     ecl_set_state(ecl, x, STATE_NUM);
 }
 
 static void op_euclid(ecl_t *ecl, int x)
 {
     int cur, pulses, steps;
-    char bang = ecl_get(ecl, x - 1);
     char arg_pulses = ecl_get(ecl, x + 1);
     char arg_steps = ecl_get(ecl, x + 2);
     char arg_cur = ecl_get(ecl, x + 3);
     
-    if (char2int(bang) > 0)
+    if (ecl_get_num(ecl, x - 1) > 0)
     {
-        steps = (!is_empty(arg_steps)) ? char2int(arg_steps) : 3;
+        steps = (!is_empty(arg_steps)) ? ecl_get_num(ecl, x + 2) : 3;
         if (steps < 1)
         {
             steps = 3;
         }
-        pulses = (!is_empty(arg_pulses)) ? char2int(arg_pulses) : 1;
+        pulses = (!is_empty(arg_pulses)) ? ecl_get_num(ecl, x + 1) : 1;
         if (pulses < 1)
         {
             pulses = 1;
@@ -488,19 +1242,20 @@ static void op_euclid(ecl_t *ecl, int x)
         if(is_empty(arg_cur)) {
             cur = 1;   
         } else {
-            cur = char2int(arg_cur) + 1;
+            cur = ecl_get_num(ecl, x + 3);
+            cur += cur < ECL_WIDE_MAX;
         }
 
-        int bucket = (pulses * (cur + steps - 1)) % steps + pulses;        
-        printf("bucket %d\n", bucket);
+        long long bucket = (long long)pulses * ((long long)cur + steps - 1) % steps + pulses;
+        printf("bucket %lld\n", bucket);
 
         if (bucket >= steps)
         {
-            ecl_set(ecl, x + 4, int2char(cur));
+            ecl_set_num(ecl, x + 4, cur);
             ecl_set_state(ecl, x + 4, STATE_NUM);
             if (cur == steps) cur = 0;
         }
-        ecl_set(ecl, x + 3, int2char(cur));
+        ecl_set_num(ecl, x + 3, cur);
         ecl_set_state(ecl, x + 3, STATE_NUM);
     }
 }
@@ -515,24 +1270,24 @@ static void op_generate(ecl_t *ecl, int x)
     char arg_mod = ecl_get(ecl, x + 2);
 
     /* Can we run this cycle? */
-    if (bang == '.' || char2int(bang) > 0)
+    if (bang == '.' || ecl_get_num(ecl, x - 1) > 0)
     {
 
-        rate = char2int((arg_rate == '?') ? bang : arg_rate);
+        rate = ecl_get_num(ecl, (arg_rate == '?') ? x - 1 : x + 1);
         if (rate < 1)
         {
             rate = 8;
         }
 
-        if (ecl->clock % rate == 0)
+        if (ecl->now % rate == 0)
         {
-            mod = char2int((arg_mod == '?') ? bang : arg_mod);
+            mod = ecl_get_num(ecl, (arg_mod == '?') ? x - 1 : x + 2);
             if (mod < 1)
             {
                 mod = 1;
             }
-            v = ((ecl->clock + 1) / rate) % mod;
-            ecl_set(ecl, x + 3, int2char(v + 1));
+            v = ((ecl->now + 1) / rate) % mod;
+            ecl_set_num(ecl, x + 3, v + 1);
             ecl_set_state(ecl, x + 3, STATE_NUM);
         }
     }
@@ -554,18 +1309,18 @@ Range of bang is 1-len(sequence).
 Bangs must be greater than zero.  */
 static void op_seq(ecl_t *ecl, int x)
 {
-    char bang = char2int(ecl_get(ecl, x - 1));
-    char len = char2int(ecl_get(ecl, x + 1));
+    int bang = ecl_get_num(ecl, x - 1);
+    int len = char2int(ecl_get(ecl, x + 1)); /* a layout key; always a digit */
     int src, tgt;
 
     if (len > 0 && bang > 0)
     {
         bang = (bang - 1) % len + 1; /* index into array of len size; force into 1-n */
         tgt = x + 2 + len;           /* output location */
-        src = ecl_get(ecl, x + 1 + bang);
-        if (src != '.')
+        src = x + 1 + bang;
+        if (ecl_get(ecl, src) != '.')
         {
-            ecl_set(ecl, tgt, src);
+            copy_num(ecl, tgt, src);
             ecl_set_state(ecl, tgt, STATE_NUM);
         }
     }
@@ -579,7 +1334,7 @@ static void op_jump(ecl_t *ecl, int x)
     char arg = ecl_get(ecl, x + 1);
     if (arg == '?')
     {
-        v = x + char2int(bang) + 1;
+        v = x + span(ecl, ecl_get_num(ecl, x - 1)) + 1;
     }
     else
     {
@@ -589,15 +1344,15 @@ static void op_jump(ecl_t *ecl, int x)
         }
         else
         {
-            v = char2int(arg);
+            v = ecl_get_num(ecl, x + 1);
             if (v < 1)
             {
                 v = 1;
             }
-            v += x + 1;
+            v = span(ecl, v) + x + 1;
         }
     }
-    ecl_set(ecl, v, bang);
+    set_copy(ecl, v, bang, ecl_get_num(ecl, x - 1));
     ecl_set_state(ecl, v, STATE_NUM);
 }
 
@@ -605,21 +1360,84 @@ static void op_var(ecl_t *ecl, int x)
 {
     char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    int v;
+    int v, value = ecl_get_num(ecl, x - 1);
 
     if (!is_empty(arg))
     {
         v = char2int(arg);
         ecl->vars[v] = bang;
+        ecl->var_values[v] = value;
         x += 2;
-        ecl_set(ecl, x, bang);
+        set_copy(ecl, x, bang, value);
         ecl_set_state(ecl, x, STATE_ARG);
         x += 1;
-        ecl_set(ecl, x, bang);
+        set_copy(ecl, x, bang, value);
         ecl_set_state(ecl, x, STATE_NUM);
     }
 }
 
+/* Append an event to those of this tick; 0 when out of memory */
+static ecl_event_t *add_event(ecl_t *ecl)
+{
+    ecl_event_t *e;
+
+    if (ecl->nevents == ecl->max_events)
+    { /* grows geometrically; steady state is allocation free */
+        if (ecl->owns & ECL_OWNS_EVENTS)
+        {
+            e = realloc(ecl->events, ecl->max_events * 2 * sizeof(ecl_event_t));
+        }
+        else if ((e = malloc(ecl->max_events * 2 * sizeof(ecl_event_t))))
+        { /* the first events live in the instance block */
+            memcpy(e, ecl->events, ecl->max_events * sizeof(ecl_event_t));
+        }
+        if (!e)
+        {
+            return 0;
+        }
+        ecl->owns |= ECL_OWNS_EVENTS;
+        ecl->events = e;
+        ecl->max_events *= 2;
+    }
+    return &ecl->events[ecl->nevents++];
+}
+
+/* Run an instance of a macro for a tick; see macro.h */
+static void op_macro(ecl_t *ecl, int x)
+{
+    ecl_t *in = macro_enter(ecl, x, char2int(ecl_get(ecl, x + 1)));
+    ecl_event_t *e;
+    int i, last;
+
+    if (in)
+    {
+        if (ecl_get_state(ecl, x - 1) == STATE_NUM)
+        {
+            set_copy(in, 0, ecl_get(ecl, x - 1), ecl_get_num(ecl, x - 1));
+        }
+        in->vars[0] = ecl_get(ecl, x + 2);
+        in->var_values[0] = ecl_get_num(ecl, x + 2);
+        last = in->memsz - 1;
+        if (in->state[last] == STATE_NUM)
+        { /* leaves the instance this tick */
+            set_copy(ecl, x + 3, ecl_get(in, last), ecl_get_num(in, last));
+            ecl_set_state(ecl, x + 3, STATE_NUM);
+        }
+        in->clock = ecl->now;
+        ecl_eval(in); /* it has no outputs, so nothing is flushed */
+        for (i = 0; i < in->nevents && (e = add_event(ecl)); i++)
+        { /* they go out with the host's, fired by the K */
+            *e = in->events[i];
+            e->x = x;
+        }
+    }
+    if (ecl_get_state(ecl, x - 1) == STATE_NUM)
+    {
+        ecl_set(ecl, x - 1, '.');
+        ecl_set_state(ecl, x - 1, STATE_EMPTY);
+    }
+}
+
 static void op_query(ecl_t *ecl, int x)
 {
     char arg = ecl_get(ecl, x + 1);
@@ -631,7 +1449,7 @@ static void op_query(ecl_t *ecl, int x)
         var = ecl->vars[char2int(arg)];
         if (!is_empty(var))
         {
-            ecl_set(ecl, x, var);
+            set_copy(ecl, x, var, ecl->var_values[char2int(arg)]);
             ecl_set_state(ecl, x, STATE_NUM);
         }
     }
@@ -641,17 +1459,18 @@ static void op_right(ecl_t *ecl, int x)
 {
     char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    int addr;
+    int addr, v = ecl_get_num(ecl, x - 1);
 
-    if (char2int(bang) > 0)
+    if (v > 0)
     {
-        addr = (arg == '?') ? char2int(bang) : (is_empty(arg) ? 1 : char2int(arg));
-        /* computer address of where to write */
-        addr = (addr == 0) ? 2 : (ecl->height * addr);
+        addr = (arg == '?') ? v : (is_empty(arg) ? 1 : ecl_get_num(ecl, x + 1));
+        /* computer address of where to write; past the last column is off
+           the grid however far */
+        addr = (addr == 0) ? 2 : (ecl->height * MIN(addr, ecl->width));
         addr += x;
         if (addr < ecl->memsz)
         {
-            ecl_set(ecl, addr, bang);
+            set_copy(ecl, addr, bang, v);
             ecl_set_state(ecl, addr, STATE_NUM);
         }
     }
@@ -661,18 +1480,18 @@ static void op_left(ecl_t *ecl, int x)
 {
     char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    int addr;
+    int addr, v = ecl_get_num(ecl, x - 1);
 
-    if (char2int(bang) > 0)
+    if (v > 0)
     {
-        addr = (arg == '?') ? char2int(bang) : (is_empty(arg) ? 1 : char2int(arg));
+        addr = (arg == '?') ? v : (is_empty(arg) ? 1 : ecl_get_num(ecl, x + 1));
         /* computer address of where to write */
-        addr = (addr == 0) ? 2 : (ecl->height * addr);
+        addr = (addr == 0) ? 2 : (ecl->height * MIN(addr, ecl->width));
         addr = x - addr;
 
         if (addr > 0)
         {
-            ecl_set(ecl, addr, bang);
+            set_copy(ecl, addr, bang, v);
             ecl_set_state(ecl, addr, STATE_NEW);
         }
     }
@@ -682,31 +1501,31 @@ static void op_dup(ecl_t *ecl, int x)
 {
     char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    int offset;
+    int offset, v = ecl_get_num(ecl, x - 1);
 
-    if (char2int(bang) > 0)
+    if (v > 0)
     {
+        offset = (arg == '?') ? v : (is_empty(arg) ? 1 : ecl_get_num(ecl, x + 1));
         x += 2;
-        ecl_set(ecl, x, bang);
+        set_copy(ecl, x, bang, v);
         ecl_set_state(ecl, x, STATE_NUM);
-        offset = (arg == '?') ? char2int(bang) : (is_empty(arg) ? 1 : char2int(arg));
-        x += (offset < 1) ? 1 : offset;
-        ecl_set(ecl, x, bang);
+        x += (offset < 1) ? 1 : span(ecl, offset);
+        set_copy(ecl, x, bang, v);
         ecl_set_state(ecl, x, STATE_NUM);
     }
 }
 
 static void op_mod(ecl_t *ecl, int x)
 {
-    char bang = ecl_get(ecl, x - 1);
     char arg = ecl_get(ecl, x + 1);
-    int v;
+    int v, a, b;
 
     if (!is_empty(arg))
     {
-        v = char2int(bang) % char2int(arg);
-        /* TODO: bounds check values */
-        ecl_set(ecl, x+2, int2char(v));
+        b = ecl_get_num(ecl, x - 1);
+        a = ecl_get_num(ecl, x + 1);
+        v = ecl->wide ? (a ? b % a : 0) : MOD[b][a]; /* mod zero gives zero */
+        ecl_set_num(ecl, x + 2, v);
         ecl_set_state(ecl, x+2, STATE_NUM);
     }
 }
@@ -715,9 +1534,9 @@ static void op_mod(ecl_t *ecl, int x)
 static void op_output(ecl_t *ecl, int x)
 {
     int i;
-    char bang = ecl_get(ecl, x - 1);
     char arg;
     int vals[5];
+    ecl_event_t *e;
 
     vals[0] = 1; /* def channel */
     vals[1] = 1; /* def note */
@@ -728,178 +1547,428 @@ static void op_output(ecl_t *ecl, int x)
     for (i = 0; i < 5; i++)
     {
         arg = ecl_get(ecl, x + i + 1);
-        vals[i] = char2int((arg == '?') ? bang : arg);
+        vals[i] = ecl_get_num(ecl, (arg == '?') ? x - 1 : x + i + 1);
     }
     /* Now bound values */
     if (vals[0] > 15)
     {
         vals[0] = 0;
     }
-    if (ecl->output_fn)
+    if (!(e = add_event(ecl)))
     {
-        ecl->output_fn(vals[0], vals[1], vals[2], vals[3], vals[4], ecl->output_ctx);
-    }
-}
-
-static void call_cmd(ecl_t *ecl, int x)
-{
-    char v = ecl->mem[x];
-    //printf("Calling %c from address %d\n", v, x);
-    switch (v)
-    {
-    case 'A':
-        op_accumulate(ecl, x);
-        break;
-    case 'C':
-        op_const(ecl, x);
-        break;
-    case 'D':
-        op_dec(ecl, x);
-        break;
-    case 'E':
-        op_euclid(ecl, x);
-        break;
-    case 'F':
-        op_if(ecl, x);
-        break;
-    case 'G':
-        op_generate(ecl, x);
-        break;
-    case 'I':
-        op_inc(ecl, x);
-        break;
-    case 'J':
-        op_jump(ecl, x);
-        break;
-    case 'M':
-        op_mod(ecl, x);
-        break;
-    case 'S':
-        op_seq(ecl, x);
-        break;
-    case 'T':
-        op_teleport_read(ecl, x);
-        break;
-    case 'O':
-        op_output(ecl, x);
-        break;
-    case 'P':
-        op_prob(ecl, x);
-        break;
-    case 'R':
-        op_rand(ecl, x);
-        break;
-    case 'V':
-        op_var(ecl, x);
-        break;
-    case 'Q':
-        op_query(ecl, x);
-        break;
-    case 'X':
-        //op_write(ecl, x);
-        break;
-    case '>':
-        op_right(ecl, x);
-        break;
-    case '<':
-        op_left(ecl, x);
-        break;
-    case '$':
-        op_dup(ecl, x);
-        break;
-    default:
-        printf("Warning: Invalid command %c", v);
-        break;
+        return;
     }
+    e->x = x;
+    e->channel = vals[0];
+    e->note = vals[1];
+    e->octave = vals[2];
+    e->velocity = vals[3];
+    e->length = vals[4];
 }
 
-/* Evaluate a memory once; no possible error state to return */
-void ecl_eval(ecl_t *ecl)
+/* Kill a bang; consuming the bang input is all there is to it */
+static void op_kill(ecl_t *ecl, int x)
 {
-    int x;
-    int y, args; /* arguments expected */
-    char v;
-    arg_t *arg;
+    (void)ecl;
+    (void)x;
+}
 
-    /* Determine current state of memory */
-    for (x = 0, args = 0; x < ecl->memsz; x++)
-    {
-        //printf("here %d\n", x);
-        if (args > 0) /* expecting args */
-        {
-            ecl->state[x] = STATE_ARG; /* not naked numbers or spaces */
-            args--;
-            continue;
-        }
-        v = ecl->mem[x];
-        if (is_empty(v))
-        { /* Most common case first */
-            ecl->state[x] = STATE_EMPTY;
-        }
-        else if (is_number(v))
-        {
-            ecl->state[x] = STATE_NUM;
-        }
-        else if (is_command(v))
-        {
-            ecl->state[x] = STATE_CMD;
-            arg = find_arg(v);
-            if (arg)
-            {
-                if (arg->varargs)
-                {
-                    /* reusing v variable here */
-                    v = ecl_get(ecl, x + 1);
-                    args = (v == '.') ? 1 : (char2int(v) + 1);
-                }
-                else
-                {
-                    args = arg->args;
-                }
-                //printf("args for %c is %d\n", v, args);
+typedef struct arg_t
+{
+    char cmd;
+    int pure,    /* always bangs, no bang input required */
+        varargs, /* argument length specifed by first argument */
+        bangs,   /* number of inputs required for a bang event; default value if varbangs true */
+        args;    /* arg counts */
+    void (*fn)(ecl_t *ecl, int x); /* called on bang; null if unimplemented */
+} arg_t;
+
+arg_t ARGS[] = {
+    /* Ideas: 
+    Accumulate (or decrease) values in a register
+    Conditional: Jump if register is zero
+    Unnamed counter/decrementer 
+    */
+
+    {'A', 0, 0, 1, 1, op_accumulate}, /* accumulate values; argument is register storage */
+    // Burst
+    {'C', 0, 0, 1, 1, op_const}, /* produce a constant value on bang */
+    {'D', 0, 0, 1, 1, op_dec}, /* decrement value of bang by arg (def 1) on output */
+    {'E', 0, 0, 1, 3, op_euclid}, /* Eucliden clock, args: pulses, steps, current */
+    {'F', 0, 0, 1, 1, op_if}, /* if bang value matches argument, allow value to pass otherwise block */
+    {'G', 1, 0, 0, 2, op_generate}, /* pure generator;  pure creators of bangs, args: rate, max */
+    // H
+    {'I', 0, 0, 1, 1, op_inc}, /* increment value of bang by arg (def 1) on output */
+    {'J', 0, 0, 1, 1, op_jump}, /* jump bang value a specified number of cells  */
+    {'K', 1, 0, 0, 2, op_macro}, /* run an instance of a macro; args: macro, parameter */
+    // L   limit?
+    {'M', 0, 0, 1, 1, op_mod}, /* mod; bang with x, arg is y, output x%y */
+    // N
+    {'O', 0, 0, 1, 5, op_output}, /* Output to a device (midi); channel, octave, note, velocity, length */  
+    // Add repeat to output?
+    {'P', 0, 0, 1, 1, op_prob}, /* continue bang probabilistically */
+    {'Q', 0, 0, 1, 1, op_query}, /* query a register on bang */
+    {'R', 0, 0, 1, 2, op_rand}, /* randomize; no args -> binary */
+    {'S', 0, 1, 1, 1, op_seq}, /* store a specified length (sequence) of numbers */
+    {'T', 0, 0, 1, 1, op_teleport_read}, /* teleport a bang to a channel */
+    {'U', 0, 0, 1, 2, op_teleport_wide}, /* teleport on a two digit channel */
+    {'V', 0, 0, 1, 2, op_var}, /* Store bang value into a named register */
+    // W
+    {'X', 0, 0, 1, 0, op_kill}, /* Kill a bang */
+    // Y
+    // Z
+    {'Z', 0, 0, 1, 1, 0}, /* Jump unless zero to address specified  */
+    {'O', 0, 0, 1, 5, op_output}, /* output to midi; channel, octave, note, velocity, length */
+    {'<', 0, 0, 1, 1, op_left}, /* redirect to left n cols */
+    {'>', 0, 0, 1, 1, op_right}, /* redirect to right n cols */
+    {'$', 0, 0, 1, 1, op_dup}, /* duplicate bang value with optional offset */
+    {0, 0, 0, 0, 0, 0},
+};
+
+static arg_t *ARG_OF[256]; /* command table entry of every byte */
+
+arg_t *find_arg(char c)
+{
+    return ARG_OF[(unsigned char)c];
+}
+
+static void tables_init(void)
+{
+    static int ready = 0;
+    int a, b;
+    unsigned char c;
+
+    if (ready)
+    {
+        return;
+    }
+    for (a = 0; a < 256; a++)
+    {
+        c = (unsigned char)a;
+        if (c >= '0' && c <= '9')
+        {
+            KIND[c] = KIND_NUM;
+            DECODE[c] = c - '0';
+        }
+        else if (c >= 'a' && c <= 'z')
+        {
+            KIND[c] = KIND_NUM;
+            DECODE[c] = c - 'a' + 10;
+        }
+        else if ((c >= 'A' && c <= 'Z') || c == '<' || c == '>' || c == '$')
+        {
+            KIND[c] = KIND_CMD;
+        }
+        else if (c == '?')
+        {
+            KIND[c] = KIND_SPECIAL;
+        }
+        STATE_OF[c] = (c == '.') ? STATE_EMPTY : (KIND[c] & KIND_NUM) ? STATE_NUM : STATE_ERR;
+    }
+    for (a = 0; a < BASE36 * 2; a++)
+    {
+        b = a % BASE36;
+        ENCODE[a] = (b <= 9) ? '0' + b : 'a' + (b - 10);
+    }
+    for (a = 0; a < BASE36; a++)
+    {
+        for (b = 0; b < BASE36; b++)
+        {
+            ADD_SAT[a][b] = (a + b > BASE36 - 1) ? BASE36 - 1 : a + b;
+            ADD_WRAP[a][b] = (a + b) % BASE36;
+            SUB_SAT[a][b] = (a > b) ? a - b : 0;
+            MOD[a][b] = b ? a % b : 0;
+        }
+    }
+    for (a = 0; ARGS[a].cmd; a++)
+    { /* first entry wins, as with a linear search */
+        c = (unsigned char)ARGS[a].cmd;
+        if (!ARG_OF[c])
+        {
+            ARG_OF[c] = &ARGS[a];
+        }
+    }
+    ready = 1;
+}
+
+/* Index the T and U receivers by channel for do_teleport: ECL_CHANNELS + 1
+   offsets into the addresses that follow, in address order within each
+   channel, then room for as many addresses again. Channel digits become
+   layout keys, so writing one rebuilds the index. Without memory for it
+   routes stays null and teleports fall back to a scan. */
+static void index_routes(ecl_t *ecl)
+{
+    int x, c, out, n = 0, need, *first, *cells;
+
+    for (x = 0; x < ecl->memsz; x++)
+    {
+        n += ecl->mem[x] == 'T' || ecl->mem[x] == 'U';
+    }
+    need = ECL_CHANNELS + 1 + 2 * n;
+    if (need > ecl->max_routes)
+    {
+        first = realloc(ecl->routes, need * sizeof(int));
+        if (!first)
+        {
+            free(ecl->routes);
+            ecl->routes = 0;
+            ecl->max_routes = 0;
+            return;
+        }
+        ecl->routes = first;
+        ecl->max_routes = need;
+    }
+    first = ecl->routes;
+    cells = first + ECL_CHANNELS + 1;
+    memset(first, 0, (ECL_CHANNELS + 1) * sizeof(int));
+    for (x = 0; x < ecl->memsz; x++)
+    {
+        c = route(ecl, x, &out);
+        if (c >= 0)
+        {
+            first[c + 1]++;
+            ecl->shape[(x + 1) % ecl->memsz] |= SHAPE_KEY;
+            if (ecl->mem[x] == 'U')
+            {
+                ecl->shape[(x + 2) % ecl->memsz] |= SHAPE_KEY;
+            }
+        }
+    }
+    for (c = 0; c < ECL_CHANNELS; c++)
+    {
+        first[c + 1] += first[c];
+    }
+    for (x = 0; x < ecl->memsz; x++)
+    { /* first[c] walks to the end of channel c... */
+        c = route(ecl, x, &out);
+        if (c >= 0)
+        {
+            cells[first[c]++] = x;
+        }
+    }
+    memmove(first + 1, first, ECL_CHANNELS * sizeof(int)); /* ...which starts c + 1 */
+    first[0] = 0;
+    ecl->nroutes = n;
+}
+
+/* Decode the command layout of memory: which cells are commands, which are
+   their arguments and how far S varargs extend. This only changes when a
+   command or a layout key is written, so ecl_eval reuses it across ticks. */
+static void compile(ecl_t *ecl)
+{
+    int x, args;
+    char v;
+    arg_t *arg;
+    ecl_instr_t *in;
+
+    if ((ecl->owns & ECL_SHARES_PROG) && !unshare(ecl))
+    {
+        return; /* keep evaluating the shared program */
+    }
+    memset(ecl->shape, 0, ecl->memsz);
+    ecl->nprog = 0;
+    for (x = 0, args = 0; x < ecl->memsz; x++)
+    {
+        if (args > 0) /* expecting args */
+        {
+            ecl->shape[x] |= STATE_ARG;
+            args--;
+            continue;
+        }
+        v = ecl->mem[x];
+        if (!is_command(v))
+        {
+            continue;
+        }
+        ecl->shape[x] |= STATE_CMD;
+        arg = find_arg(v);
+        if (arg)
+        {
+            if (arg->varargs)
+            {
+                /* reusing v variable here */
+                v = ecl_get(ecl, x + 1);
+                args = (v == '.') ? 1 : (char2int(v) + 1);
+                ecl->shape[(x + 1) % ecl->memsz] |= SHAPE_KEY;
             }
             else
             {
-                printf("Invalid command %c at %d\n", v, x);
+                args = arg->args;
+            }
+        }
+        else
+        {
+            printf("Invalid command %c at %d\n", v, x);
+        }
+        in = &ecl->prog[ecl->nprog++];
+        in->x = x;
+        in->args = args;
+        in->op = arg;
+    }
+    index_routes(ecl);
+    ecl->compiled = 1;
+    if (ecl->macros)
+    {
+        macro_prune(ecl);
+    }
+}
+
+/* Evaluate a memory once; no possible error state to return */
+/* Run a pass over the columns of every clock once for each of its ticks
+   due on this tick of ecl_eval, and over the other columns once, from the
+   last column down as a single pass over memory would go */
+static void schedule(ecl_t *ecl)
+{
+    const ecl_clock_t *c, *next;
+    long long t = ecl->clock, tick, due;
+    int end = ecl->width, h = ecl->height, i, lo, hi;
+
+    ecl->now = ecl->clock;
+    if (!ecl->nclocks)
+    {
+        pass(ecl, 0, ecl->memsz);
+        return;
+    }
+    for (;;)
+    {
+        next = 0; /* the clock of the last columns before end */
+        for (i = 0; i < ECL_CLOCKS; i++)
+        {
+            c = &ecl->clocks[i];
+            if (c->cols > 0 && c->col < end && (!next || c->col > next->col))
+            {
+                next = c;
             }
         }
-        /* Special case? */
+        lo = next ? next->col : 0;
+        hi = next ? MIN(next->col + next->cols, end) : 0;
+        if (hi < end)
+        {
+            ecl->now = ecl->clock;
+            pass(ecl, hi * h, end * h);
+        }
+        if (!next)
+        {
+            break;
+        }
+        tick = t * next->mul / next->div;
+        due = (t + 1) * next->mul / next->div;
+        for (; tick < due; tick++)
+        {
+            ecl->now = (int)tick;
+            pass(ecl, lo * h, hi * h);
+        }
+        end = lo;
+    }
+    ecl->now = ecl->clock;
+}
+
+/* Index of the last compiled command below address hi; -1 if none */
+static int prog_below(ecl_t *ecl, int hi)
+{
+    int lo = 0, n = ecl->nprog, mid;
+
+    while (lo < n)
+    {
+        mid = (lo + n) / 2;
+        if (ecl->prog[mid].x < hi)
+        {
+            lo = mid + 1;
+        }
         else
         {
-            ecl->state[x] = STATE_ERR;
+            n = mid;
+        }
+    }
+    return lo - 1;
+}
+
+/* Determine the state of memory as a tick starts; commands and their
+   arguments come from the compiled layout, everything else from the cell
+   value. Taken once for all columns, whatever their clocks. */
+static void classify(ecl_t *ecl)
+{
+    int x, role;
+    char v;
+
+    if (!ecl->compiled)
+    {
+        compile(ecl);
+    }
+    for (x = 0; x < ecl->memsz; x++)
+    {
+        role = ecl->shape[x] & SHAPE_ROLE;
+        if (role)
+        {
+            ecl->state[x] = role;
+            continue;
+        }
+        v = ecl->mem[x];
+        ecl->state[x] = STATE_OF[(unsigned char)v];
+        if (ecl->state[x] == STATE_ERR)
+        {
             printf("Invalid state at %d val %c\n", x, v);
         }
     }
+}
+
+/* One tick of the cells from lo up to hi, with states from classify */
+static void pass(ecl_t *ecl, int lo, int hi)
+{
+    int x, k, y;
+    const arg_t *arg;
 
     /* Second, we will evaluate from higher address to lower and exec (bang) all 
         commands that have valid triggers, and move numbers higher in memory if possible. 
-        This pass will now know arguments from plain (and moveable) numbers.  */
+        This pass will now know arguments from plain (and moveable) numbers. Commands
+        are taken from the compiled program, walked down alongside x. */
 
-    for (x = ecl->memsz - 1; x >= 0; x--)
+    for (x = hi - 1, k = prog_below(ecl, hi); x >= lo; x--)
     {
-        if (ecl_get_state(ecl, x) == STATE_NUM)
+        if (ecl->state[x] == STATE_NUM)
         {
             if ((x + 1) % ecl->height == 0) /* delete number if at bottom */
             {
                 ecl_set(ecl, x, '.');
                 ecl_set_state(ecl, x, STATE_EMPTY);
+                ecl->stats.deleted++;
             } /* move number if possible */
             else if (ecl_get_state(ecl, x + 1) == STATE_EMPTY)
             {
-                ecl_set(ecl, x + 1, ecl_get(ecl, x));
+                ecl->stats.moved++;
+                copy_num(ecl, x + 1, x);
                 ecl_set_state(ecl, x + 1, STATE_NUM);
                 ecl_set(ecl, x, '.');
                 ecl_set_state(ecl, x, STATE_EMPTY);
             }
         }
-        else if (ecl_get_state(ecl, x) == STATE_CMD)
+        else if (ecl->state[x] == STATE_CMD)
         {
-            arg = find_arg(ecl_get(ecl, x));
+            while (k > 0 && ecl->prog[k].x > x)
+            {
+                k--;
+            }
+            arg = (ecl->prog[k].x == x) ? ecl->prog[k].op : find_arg(ecl->mem[x]);
             if (arg)
             {
                 if (can_bang(ecl, x, arg->bangs) || arg->pure)
                 {
-                    call_cmd(ecl, x);
+                    visual_fire(ecl, x);
+                    ecl->stats.fires[arg->cmd & 127]++;
+                    if (arg->fn)
+                    {
+#ifdef ECL_PROFILE
+                        unsigned long long t0 = CYCLES();
+                        arg->fn(ecl, x);
+                        ecl->stats.cycles[arg->cmd & 127] += CYCLES() - t0;
+#else
+                        arg->fn(ecl, x);
+#endif
+                    }
+                    else
+                    {
+                        printf("Warning: Invalid command %c", ecl->mem[x]);
+                    }
                     for (y = 1; y <= arg->bangs; y++)
                     {
                         /* zero out all bang values */
@@ -910,75 +1979,348 @@ void ecl_eval(ecl_t *ecl)
             }
         }
     }
+}
+
+void ecl_eval(ecl_t *ecl)
+{
+    ecl->nevents = 0;
+    visual_decay(ecl);
+    classify(ecl);
+    schedule(ecl);
     do_teleport(ecl);
+    ecl->stats.events += ecl->nevents;
+    flush_events(ecl);
     ecl->clock++;
+    ecl->stats.ticks++;
+    if (ecl->stats_every && ecl->stats.ticks >= (unsigned long)ecl->stats_every)
+    {
+        ecl_stats_dump(ecl, ecl->stats_file);
+        ecl_stats_reset(ecl);
+    }
 }
 
-int ecl_load_buffer(ecl_t *ecl, const char *buffer,
-                    int len, int offset)
+const char *ecl_vocabulary(void)
 {
-    int i;
-    if (ecl)
+    static char letters[sizeof(ARGS) / sizeof(ARGS[0])];
+    const arg_t *arg;
+    int n = 0;
+
+    if (!letters[0])
     {
-        for (i = 0; i < len; i++)
+        for (arg = ARGS; arg->cmd; arg++)
         {
-            //printf("examining %c from %d of len %d\n", buffer[i], i, len);
-            if (buffer[i] == '.')
+            if (!memchr(letters, arg->cmd, n))
             {
-                offset++;
+                letters[n++] = arg->cmd;
             }
-            else if (valid_char(buffer[i]))
+        }
+    }
+    return letters;
+}
+
+int ecl_load_buffer(ecl_t *ecl, const char *buffer,
+                    int len, int offset)
+{
+    int i, x, wrote = 0;
+    unsigned char c;
+
+    if (!ecl)
+    {
+        return 0;
+    }
+    /* '.' skips a cell, valid values are written straight into mem and
+       anything else (line ends included) is ignored; the offset carries over
+       between calls, so a stream can be fed in pieces of any size */
+    x = abs(offset) % ecl->memsz;
+    for (i = 0; i < len; i++)
+    {
+        c = (unsigned char)buffer[i];
+        if (KIND[c])
+        {
+            ecl->mem[x] = (char)c;
+            if (ecl->wide)
             {
-                ecl_set(ecl, offset, buffer[i]);
-                offset++;
-                printf("loaded %c from %d into %d\n", buffer[i], i, offset);
+                ecl->wide[x] = DECODE[c];
             }
+            wrote = 1;
+        }
+        else if (c != '.')
+        {
+            continue;
         }
-        return offset;
+        offset++;
+        if (++x == ecl->memsz)
+        {
+            x = 0;
+        }
+    }
+    if (wrote)
+    {
+        ecl->compiled = 0;
     }
-    return 0;
+    return offset;
 }
 
-#define MAX_LINE_SIZE 1024
+#define LOAD_CHUNK 65536
 
 int ecl_load(ecl_t *ecl, FILE *file)
 {
-    int len;
+    char buf[LOAD_CHUNK];
+    size_t n;
     int offset = 0;
-    char buf[MAX_LINE_SIZE];
 
-    if (file)
+    if (!ecl || !file)
+    {
+        return 0;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        offset = ecl_load_buffer(ecl, buf, (int)n, offset);
+    }
+    return !ferror(file);
+}
+
+int ecl_load_fd(ecl_t *ecl, int fd)
+{
+    char buf[LOAD_CHUNK];
+    ssize_t n;
+    int offset = 0;
+
+    if (!ecl)
+    {
+        return 0;
+    }
+    for (;;)
+    {
+        n = read(fd, buf, sizeof(buf));
+        if (n > 0)
+        {
+            offset = ecl_load_buffer(ecl, buf, (int)n, offset);
+        }
+        else if (n == 0)
+        {
+            return 1;
+        }
+        else if (errno != EINTR)
+        {
+            return 0;
+        }
+    }
+}
+#undef LOAD_CHUNK
+
+/* Clip a w by h rectangle at column x, row y to memory; returns 0 when
+   nothing is left. The offsets say where the clipped part starts inside the
+   rectangle. */
+static int clip(ecl_t *ecl, int *x, int *y, int *w, int *h, int *dx, int *dy)
+{
+    *dx = *x < 0 ? -*x : 0;
+    *dy = *y < 0 ? -*y : 0;
+    *x += *dx;
+    *y += *dy;
+    *w = MIN(*w - *dx, ecl->width - *x);
+    *h = MIN(*h - *dy, ecl->height - *y);
+    return *w > 0 && *h > 0;
+}
+
+void ecl_blit(ecl_t *ecl, int x, int y, const char *cells, int w, int h, int transparent)
+{
+    int col, i, dx, dy, cw = w, ch = h;
+    const char *src;
+    char *dst;
+
+    if (!ecl || !cells || !clip(ecl, &x, &y, &cw, &ch, &dx, &dy))
+    {
+        return;
+    }
+    for (col = 0; col < cw; col++)
+    {
+        src = cells + (size_t)(dx + col) * h + dy;
+        dst = ecl->mem + (size_t)(x + col) * ecl->height + y;
+        if (!transparent)
+        {
+            memcpy(dst, src, ch);
+        }
+        else
+        {
+            for (i = 0; i < ch; i++)
+            {
+                dst[i] = (src[i] == '.') ? dst[i] : src[i];
+            }
+        }
+        for (i = 0; ecl->wide && i < ch; i++)
+        {
+            ecl->wide[dst - ecl->mem + i] = DECODE[(unsigned char)dst[i]];
+        }
+    }
+    ecl->compiled = 0;
+}
+
+void ecl_extract(ecl_t *ecl, int x, int y, int w, int h, char *cells)
+{
+    int col, dx, dy, cw = w, ch = h;
+
+    if (!ecl || !cells || w < 1 || h < 1)
     {
-        while (fgets(buf, MAX_LINE_SIZE, file))
+        return;
+    }
+    memset(cells, '.', (size_t)w * h);
+    if (!clip(ecl, &x, &y, &cw, &ch, &dx, &dy))
+    {
+        return;
+    }
+    for (col = 0; col < cw; col++)
+    {
+        memcpy(cells + (size_t)(dx + col) * h + dy,
+               ecl->mem + (size_t)(x + col) * ecl->height + y, ch);
+    }
+}
+
+char *ecl_parse_region(const char *text, size_t len, int *w, int *h)
+{
+    size_t i, n, start;
+    char *cells;
+    int col;
+
+    /* one column per line; the longest line sets the height */
+    *w = *h = 0;
+    for (i = 0, start = 0; i <= len; i++)
+    {
+        if (i == len || text[i] == '\n')
+        {
+            n = i - start - (i > start && text[i - 1] == '\r');
+            if (i < len || n > 0)
+            {
+                (*w)++;
+                *h = MAX(*h, (int)n);
+            }
+            start = i + 1;
+        }
+    }
+    if (*w == 0 || *h == 0)
+    {
+        *w = *h = 0;
+        return 0;
+    }
+    cells = malloc((size_t)*w * *h);
+    if (!cells)
+    {
+        return 0;
+    }
+    memset(cells, '.', (size_t)*w * *h);
+    for (i = 0, start = 0, col = 0; i <= len && col < *w; i++)
+    {
+        if (i == len || text[i] == '\n')
         {
-            len = ((int)strlen(buf) - 1);
-            if (len > 0)
+            for (n = start; n < i; n++)
             {
-                offset = ecl_load_buffer(ecl, buf, len, offset);
+                if (valid_char(text[n]))
+                {
+                    cells[(size_t)col * *h + (n - start)] = text[n];
+                }
             }
+            col++;
+            start = i + 1;
         }
-        return 1;
     }
-    return 0;
+    return cells;
 }
-#undef MAX_LINE_SIZE
 
-int ecl_save(ecl_t *ecl, FILE *file)
+char *ecl_read_region(FILE *file, int *w, int *h)
 {
-    int i;
-    if (ecl && file)
+    char *text = 0, *cells, *grown;
+    size_t len = 0, cap = 0, n;
+
+    if (!file)
     {
-        for (i = 0; i < ecl->memsz; i++)
+        return 0;
+    }
+    do
+    {
+        if (len == cap)
         {
-            if (i > 0 && i % 16 == 0)
+            cap = cap ? cap * 2 : 65536;
+            grown = realloc(text, cap);
+            if (!grown)
             {
-                fputc('\n', file);
+                free(text);
+                return 0;
             }
-            fputc((int)ecl->mem[i], file);
+            text = grown;
         }
-        return 1;
+        n = fread(text + len, 1, cap - len, file);
+        len += n;
+    } while (n > 0);
+    cells = ecl_parse_region(text, len, w, h);
+    free(text);
+    return cells;
+}
+
+int ecl_load_layer(ecl_t *ecl, FILE *file, int x, int y)
+{
+    int w, h;
+    char *cells = ecl_read_region(file, &w, &h);
+
+    if (!ecl || !cells)
+    {
+        free(cells);
+        return 0;
     }
-    return 0;
+    ecl_blit(ecl, x, y, cells, w, h, 1);
+    free(cells);
+    return 1;
+}
+
+int ecl_load_module(ecl_t *ecl, const char *spec)
+{
+    char path[4096];
+    const char *at = strrchr(spec, '@');
+    int x = 0, y = 0, ok;
+    size_t n = at ? (size_t)(at - spec) : strlen(spec);
+    FILE *file;
+
+    if (n >= sizeof(path) || (at && sscanf(at + 1, "%d,%d", &x, &y) != 2))
+    {
+        return 0;
+    }
+    memcpy(path, spec, n);
+    path[n] = '\0';
+    file = fopen(path, "r");
+    ok = ecl_load_layer(ecl, file, x, y);
+    if (file)
+    {
+        fclose(file);
+    }
+    return ok;
+}
+
+int ecl_save_region(ecl_t *ecl, FILE *file, int x, int y, int w, int h)
+{
+    char *cells;
+    int col;
+
+    if (!ecl || !file || w < 1 || h < 1)
+    {
+        return 0;
+    }
+    cells = malloc((size_t)w * h);
+    if (!cells)
+    {
+        return 0;
+    }
+    ecl_extract(ecl, x, y, w, h, cells);
+    for (col = 0; col < w; col++)
+    {
+        fwrite(cells + (size_t)col * h, 1, h, file);
+        fputc('\n', file);
+    }
+    free(cells);
+    return !ferror(file);
+}
+
+int ecl_save(ecl_t *ecl, FILE *file)
+{
+    return ecl && ecl_save_region(ecl, file, 0, 0, ecl->width, ecl->height);
 }
 
 #undef MIN
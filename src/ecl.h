@@ -3,9 +3,27 @@
 #ifndef _ECL_H_
 #define _ECL_H_
 
+#include <stddef.h>
+#include <stdio.h>
+
 #include "rng.h"
 
 #define BASE36 36
+#define ECL_CHANNELS (BASE36 * BASE36) /* teleport channels; T reaches the first BASE36 */
+#define ECL_CLOCKS 8                    /* clock domains; see ecl_set_clock */
+#define ECL_WIDE_MAX 0x7fffffff         /* largest wide value; see ecl_set_wide */
+
+#define ECL_ALIGN 64 /* alignment of instance blocks; a cache line */
+
+/* ecl_t.owns bits: what ecl_free must release */
+#define ECL_OWNS_BLOCK 1  /* the block holding the instance (ecl_new) */
+#define ECL_OWNS_CELLS 2  /* per-cell arrays, moved out by ecl_resize */
+#define ECL_OWNS_EVENTS 4 /* events, moved out when more fire in a tick */
+#define ECL_SHARES_PROG 8 /* shape and prog are another instance's */
+#define ECL_OWNS_PROG 16  /* shape and prog on the heap, apart from cells */
+
+#define ECL_VISUAL_FIRE 96     /* heat a cell gains each time it fires */
+#define ECL_VISUAL_HALF_LIFE 4 /* ticks for heat to halve */
 
 enum
 {
@@ -25,50 +43,186 @@ enum
 //       memsz;
 //   char *mem;
 //   int *state;
-//   int *visual; /* visual state */
-//   int *clocks;
 //   char vars[BASE36]; /* teleport variable storage */
 //   rng_t *rng;
 
 //   //void (*output_fn)(int type, int command, void* ctx);
 // } ecl_t;
 
+/* A decoded command: its address, its entry in the command table and the
+   number of argument cells that follow it */
+typedef struct ecl_instr_t
+{
+  int x, args;
+  const struct arg_t *op;
+} ecl_instr_t;
+
+/* A note event fired by an O command during ecl_eval */
+typedef struct ecl_event_t
+{
+  int x, /* address of the O command */
+      channel, note, octave, velocity, length;
+} ecl_event_t;
+
+/* Interpreter counters, accumulated by ecl_eval until ecl_stats_reset */
+typedef struct ecl_stats_t
+{
+  unsigned long ticks,
+      fires[128], /* commands banged, by command letter */
+      moved,      /* numbers moved down a cell */
+      deleted,    /* numbers deleted at the bottom edge */
+      teleports,  /* values delivered by T */
+      events;     /* events fired by O */
+  unsigned long long cycles[128]; /* cycles spent in each command; only
+                                     counted when built with ECL_PROFILE */
+} ecl_stats_t;
+
+/* Columns with a clock of their own; see ecl_set_clock */
+typedef struct ecl_clock_t
+{
+  int col, cols, /* no columns when unused */
+      mul, div;
+} ecl_clock_t;
+
 typedef struct ecl_t
 {
   int clock,
       memsz;
+  int now; /* clock of the columns being evaluated */
+  ecl_clock_t clocks[ECL_CLOCKS];
+  int nclocks; /* clocks in use */
   char vars[BASE36];     /* variable storage */
-  char channels[BASE36]; /* teleport storage */
+  int var_values[BASE36]; /* values of vars, wide ones included */
+  int channels[ECL_CHANNELS]; /* teleport storage */
+  short sent[ECL_CHANNELS];    /* channels written this tick */
+  unsigned char marks[ECL_CHANNELS / 8]; /* bit per channel in sent */
+  int nsent;
   char *mem;
   int width, height;
+  int capacity; /* cells allocated for mem and the other per-cell arrays */
+  int owns;     /* ECL_OWNS_* bits */
   int *state;
+  unsigned char *shape; /* compiled role of each cell; see ecl_eval */
+  ecl_instr_t *prog;    /* compiled commands in address order */
+  unsigned char *heat;  /* activity of each cell, and whether it just fired */
+  int *warm;            /* cells with heat, on the heap */
+  int nwarm, max_warm;
+  int nprog,
+      compiled; /* prog and shape match mem */
+  int *routes; /* T and U receivers by channel; see compile */
+  int *wide;   /* value of every cell, capacity of them; null unless wide */
+  int nroutes, max_routes;
   rng_t *rng;
   void (*output_fn)(int channel, int note, int octave, int velocity, int length, void *ctx); /* midi output fn */
   void *output_ctx;
+  ecl_event_t *events; /* events of the last tick, reused every tick */
+  int nevents, max_events;
+  void (*batch_fn)(const ecl_event_t *events, int count, int tick, void *ctx);
+  void *batch_ctx;
+  ecl_stats_t stats;
+  FILE *stats_file; /* see ecl_stats_every */
+  int stats_every;
+  struct macro_t *macros; /* definitions and instances; see macro.h */
 } ecl_t;
 
 /* Create an ECL memory; size is defined by width (x) and height (y); stored in linear array */
 ecl_t *ecl_new(int x, int y, unsigned long seed);
 
+/* Bytes of the block ecl_new_in needs for an x by y memory; 0 if invalid */
+size_t ecl_footprint(int x, int y);
+
+/* Create an ECL memory inside block, which must be ECL_ALIGN aligned and at
+   least ecl_footprint(x, y) bytes. The instance, its RNG and all per-cell
+   arrays are placed in the block, each part on its own cache lines.
+   ecl_free releases only what was allocated later (on resize or when many
+   events fire); the block stays the caller's. */
+ecl_t *ecl_new_in(void *block, size_t size, int x, int y, unsigned long seed);
+
+/* Create an instance with the size and memory of proto that evaluates from
+   the compiled program of proto instead of one of its own, until its
+   commands are rewritten. proto must not change while this lives. */
+ecl_t *ecl_new_sharing(ecl_t *proto, unsigned long seed);
+
 void ecl_set_output(ecl_t *ecl,
                     void (*output_fn)(int channel, int note, int octave, int velocity, int length, void *ctx),
                     void *ctx);
 
+/* Deliver all events of a tick in one call once the tick is evaluated; tick
+   is the clock value the events fired at. Called before any output_fn. */
+void ecl_set_output_batch(ecl_t *ecl,
+                          void (*batch_fn)(const ecl_event_t *events, int count, int tick, void *ctx),
+                          void *ctx);
+
+/* Counters since the last reset */
+const ecl_stats_t *ecl_stats(ecl_t *ecl);
+
+/* Zero the counters */
+void ecl_stats_reset(ecl_t *ecl);
+
+/* Print the counters, busiest commands first */
+void ecl_stats_dump(ecl_t *ecl, FILE *file);
+
+/* Dump and reset the counters to file every n ticks; 0 stops */
+void ecl_stats_every(ecl_t *ecl, int n, FILE *file);
+
+/* Events fired by the last ecl_eval; valid until the next one */
+const ecl_event_t *ecl_events(ecl_t *ecl, int *count);
+
 /* TODO: rename */
 int valid_char(char c);
 
+/* Resize the memory to w columns of h cells. Cells keep their column and
+   row; new cells are empty. Capacity grows geometrically, so repeated
+   growth is amortized and shrinking never reallocates. Returns 0 when out
+   of memory, leaving ecl as it was. */
+int ecl_resize(ecl_t *ecl, int w, int h);
+
 /* Destroy an ECL memory and associated resources */
 void ecl_free(ecl_t *ecl);
 
-/* Load a saved memory into an ECL structure; returns true on success */
+/* Load a saved memory into an ECL structure; returns true on success.
+   Files are read in large chunks, so lines can be of any length. */
 int ecl_load(ecl_t *ecl, FILE *file);
 
-/* Load a buffer into an ECL structure; returns non-zero value on success. */
+/* As ecl_load, reading a file descriptor until end of file */
+int ecl_load_fd(ecl_t *ecl, int fd);
+
+/* Load len bytes of program text into memory from offset on, wrapping at
+   the end; '.' skips a cell and characters that are not values, such as
+   line ends, are ignored. Returns the offset following the last cell. */
 int ecl_load_buffer(ecl_t *ecl, const char *buffer, int len, int offset);
 
-/* Save the ECL state to a file */
+/* Save the memory to a file, one column per line, so ecl_load and
+   ecl_load_layer both read it back */
 int ecl_save(ecl_t *ecl, FILE *file);
 
+/* Save the w by h rectangle at column x, row y, one column per line */
+int ecl_save_region(ecl_t *ecl, FILE *file, int x, int y, int w, int h);
+
+/* Copy a w by h rectangle of cells, stored column by column, to column x,
+   row y; the parts falling outside memory are dropped. With transparent
+   set, '.' cells leave memory as it was, so programs can be layered. */
+void ecl_blit(ecl_t *ecl, int x, int y, const char *cells, int w, int h, int transparent);
+
+/* Copy the w by h rectangle at column x, row y into cells, column by
+   column; cells outside memory read as '.' */
+void ecl_extract(ecl_t *ecl, int x, int y, int w, int h, char *cells);
+
+/* Read a program file, one column per line, into a rectangle as wide as
+   the file has lines and as high as its longest line. Returns the cells,
+   to be freed by the caller, or 0. */
+char *ecl_read_region(FILE *file, int *w, int *h);
+
+/* As ecl_read_region, from len bytes of text */
+char *ecl_parse_region(const char *text, size_t len, int *w, int *h);
+
+/* Load a program file as a layer with its top left at column x, row y;
+   '.' cells are transparent, so layers loaded in turn compose one grid */
+int ecl_load_layer(ecl_t *ecl, FILE *file, int x, int y);
+
+/* Load a layer given as "path" or "path@x,y" */
+int ecl_load_module(ecl_t *ecl, const char *spec);
+
 /* Dump memory to stdout */
 void ecl_dump(ecl_t *ecl);
 
@@ -76,21 +230,65 @@ void ecl_dump(ecl_t *ecl);
 /* TODO: cannot really fail, change return to void? */
 void ecl_eval(ecl_t *ecl);
 
+/* The command letters the interpreter knows, as a string */
+const char *ecl_vocabulary(void);
+
 /* Get the state at memory position x */
 int ecl_get_state(ecl_t *ecl, int x);
 
-/* Get the visual state at memory position x */
+/* Get the activity at memory position x: 0 for a cell that has not fired
+   lately, up to 255 for one that fires every tick */
 int ecl_get_visual(ecl_t *ecl, int x);
 
+/* Get the tick the cell at memory position x last fired: exact when that
+   was the last tick, otherwise rounded down to a multiple of
+   ECL_VISUAL_HALF_LIFE. -1 when its activity has decayed to zero. */
+int ecl_get_fired(ecl_t *ecl, int x);
+
 /* Get the value at memory position x */
 char ecl_get(ecl_t *ecl, int x);
 
 /* Set the value at memory position x with val */
 void ecl_set(ecl_t *ecl, int x, char val);
 
+/* Wide values: every cell carries an int beside its glyph, and commands
+   compute with it in full, up to ECL_WIDE_MAX, instead of a single base 36
+   digit. The glyph shows the value modulo 36; writing a glyph sets the
+   value to its digit. Off by default; turning it on takes the values from
+   the glyphs. Returns 0 when out of memory. */
+int ecl_set_wide(ecl_t *ecl, int on);
+
+/* Clock domains: columns col to col + cols - 1 follow clock id, which
+   ticks mul times for every div ticks of ecl_eval; other columns tick with
+   ecl_eval. Each tick, the state of every cell is taken once, then the
+   columns of a clock are evaluated once for every tick of it due, in their
+   place in the pass from the last column down; a slow clock's columns do
+   not run between its ticks. Clocks only change when columns run, so 1:1
+   clocks change nothing. G counts the ticks of the clock of its column.
+   At tick t of ecl_eval a clock is at t * mul / div,
+   so it follows resets and seeks. cols = 0 removes clock id. Returns 0
+   when id is not below ECL_CLOCKS, mul or div is below 1 or the columns
+   overlap those of another clock. */
+int ecl_set_clock(ecl_t *ecl, int id, int col, int cols, int mul, int div);
+
+/* Set a clock given as "id=col,cols,mul" or "id=col,cols,mul/div" */
+int ecl_clock_spec(ecl_t *ecl, const char *spec);
+
+/* Get the number at memory position x; its digit unless wide */
+int ecl_get_num(ecl_t *ecl, int x);
+
+/* Set the number at memory position x to v */
+void ecl_set_num(ecl_t *ecl, int x, int v);
+
+/* Value of a base 36 digit; 0 for anything else */
+int char2int(char c);
+
 /* Reset internal state */
 void ecl_reset(ecl_t *ecl);
 
+/* Drop the compiled program; needed only after writing mem without ecl_set */
+void ecl_invalidate(ecl_t *ecl);
+
 /* need to add:
  Type for each cell?
  Output handlers? (midi, udp, etc)
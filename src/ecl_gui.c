@@ -7,8 +7,6 @@
 #include "ecl.h"
 
 #define ROTATE 1
-#define HOR 64
-#define VER 32
 #define PAD 8
 #define color1 0x000000 /* Black */
 #define color2 0x72DEC2 /* Turquoise 0x72DEC2, console green 0x399612 */
@@ -204,8 +202,8 @@ typedef struct
 } Rect2d;
 
 int colors[] = {color1, color2, color3, color4, color0};
-int WIDTH = 8 * HOR + PAD * 2;
-int HEIGHT = 8 * VER + PAD * 2;
+int HOR = 64, VER = 32; /* grid size in cells, see -w and -h */
+int WIDTH, HEIGHT;
 int FPS = 30, DOWN = 0, ZOOM = 2, PAUSE = 0;
 SDL_Window *gWindow = NULL;
 SDL_Renderer *gRenderer = NULL;
@@ -737,10 +735,25 @@ void midi_output(int channel, int note, int octave, int velocity, int length, vo
 
 int main(int argc, char *argv[])
 {
-	int ticknext = 0, tickrun = 0;
+	int ticknext = 0, tickrun = 0, i;
 
-	(void)argc;
-	(void)argv;
+	for (i = 1; i < argc - 1; i++)
+	{
+		if (!strcmp(argv[i], "-w"))
+		{
+			HOR = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-h"))
+		{
+			VER = atoi(argv[++i]);
+		}
+	}
+	if (HOR < 1 || VER < 1)
+	{
+		return error("Size", "Invalid grid size");
+	}
+	WIDTH = 8 * HOR + PAD * 2;
+	HEIGHT = 8 * VER + PAD * 2;
 
 	if (!init())
 	{
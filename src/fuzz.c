@@ -0,0 +1,106 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "reference.h"
+
+/* Fuzz target for loading and running programs. The first two bytes of an
+   input pick the grid size, and the top bit of the first wide values; the
+   rest is loaded with ecl_load_buffer and run for FUZZ_TICKS ticks,
+   alternating the compiled and reference evaluators.
+
+   libFuzzer:  scons fuzz=1, then bin/fuzz -close_fd_mask=1 corpus
+   AFL:        build fuzz.c with afl-cc, then afl-fuzz -i corpus -o out bin/fuzz @@
+   Replay:     bin/fuzz with corpus files, which is how kept crashes are rerun */
+
+#define FUZZ_TICKS 64
+#define FUZZ_MAX_SIDE 64
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    ecl_t *ecl;
+    int i;
+
+    if (size < 2)
+    {
+        return 0;
+    }
+    ecl = ecl_new(1 + data[0] % FUZZ_MAX_SIDE, 1 + data[1] % FUZZ_MAX_SIDE, (unsigned long)size);
+    if (!ecl)
+    {
+        return 0;
+    }
+    if (data[0] & 0x80)
+    {
+        ecl_set_wide(ecl, 1);
+    }
+    ecl_load_buffer(ecl, (const char *)data + 2, (int)(size - 2), 0);
+    for (i = 0; i < FUZZ_TICKS; i++)
+    {
+        if (i & 1)
+        {
+            reference_eval(ecl);
+        }
+        else
+        {
+            ecl_eval(ecl);
+        }
+    }
+    ecl_free(ecl);
+    return 0;
+}
+
+#ifndef ECL_LIBFUZZER
+
+/* Run the target once per file, or once on stdin */
+static int run_file(FILE *file)
+{
+    uint8_t *data = 0, *grown;
+    size_t size = 0, cap = 0, n;
+
+    do
+    {
+        if (size == cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            grown = realloc(data, cap);
+            if (!grown)
+            {
+                free(data);
+                return 0;
+            }
+            data = grown;
+        }
+        n = fread(data + size, 1, cap - size, file);
+        size += n;
+    } while (n > 0);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *file;
+    int i;
+
+    if (argc < 2)
+    {
+        return !run_file(stdin);
+    }
+    for (i = 1; i < argc; i++)
+    {
+        file = fopen(argv[i], "rb");
+        if (!file || !run_file(file))
+        {
+            printf("Failed to run %s\n", argv[i]);
+            return 1;
+        }
+        fclose(file);
+    }
+    return 0;
+}
+
+#endif
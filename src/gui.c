@@ -8,20 +8,32 @@
 #include <porttime.h>
 
 #include "ecl.h"
-#include "font.h"
+#include "canvas.h"
+#include "block.h"
+#include "timeline.h"
+#include "journal.h"
+#include "macro.h"
+#include "output.h"
+#include "remote.h"
 
 #define NUM_VOICES 16
+#define MAX_LAYERS 16 /* -l module files */
 
-// #define MIDI_VOICES 16
+#define HEATMAP_WINDOW 64 /* ticks the overlay roughly averages over */
+
+/* What the heatmap overlay tints tiles by; ctrl+h cycles */
+enum
+{
+    HEATMAP_OFF = 0,
+    HEATMAP_FIRES,  /* how often a command banged */
+    HEATMAP_COST,   /* fires weighted by cycles per fire of the command */
+    HEATMAP_EVENTS, /* events emitted by an O */
+    HEATMAP_MODES
+};
 
-Uint32 theme[] = {
-    0x000000,
-    0x72DEC2,
-    0xFFFFFF,
-    0x444444,
-    0xffff00,
-    0x666666,
-    0xffb545};
+static const char *heatmap_names[] = {"off", "fires", "cost", "events"};
+
+// #define MIDI_VOICES 16
 
 typedef struct
 {
@@ -38,13 +50,20 @@ typedef struct gui_t
     SDL_Window *window;
     SDL_Renderer *renderer;
     SDL_Texture *texture;
-    Uint32 *pixels;
+    canvas_t *canvas;
     int hor, ver, pad, width, height, pause, fps, zoom, device, down;
     //PmStream *midi;
     //note_t *voices;
     rect_t cursor;
-    char *clip;
+    block_t *clip;
     ecl_t *ecl;
+    timeline_t *timeline;
+    journal_t *journal;
+    outputs_t *outputs;
+    remote_t *remote;
+    int heatmap;
+    float *hits; /* decayed per-cell count for the overlay */
+    int nhits;
 } gui_t;
 
 note_t voices[NUM_VOICES];
@@ -115,15 +134,36 @@ void midi_output(int channel, int note, int octave, int velocity, int length, vo
     }
 }
 
-gui_t *gui_new()
+static int midi_send(output_sink_t *sink, int tick, const ecl_event_t *events, int count)
+{
+    int i;
+    (void)tick;
+    for (i = 0; i < count; i++)
+    {
+        midi_output(events[i].channel, events[i].note, events[i].octave,
+                    events[i].velocity, events[i].length, sink);
+    }
+    return 1;
+}
+
+static void midi_free(output_sink_t *sink)
 {
-    int i, j;
+    (void)sink;
+}
+
+static output_sink_t midi_sink = {midi_send, midi_free};
+
+gui_t *gui_new(int hor, int ver)
+{
+    int i;
     gui_t *gui;
 
     gui = calloc(1, sizeof(gui_t));
-    gui->hor = 32;
-    gui->ver = 48;
+    gui->hor = hor;
+    gui->ver = ver;
     gui->ecl = ecl_new(gui->hor, gui->ver, (unsigned long)42);
+    gui->timeline = timeline_new(64, 30 * 60 * 10); /* ten minutes at full speed */
+    gui->journal = journal_new();
     gui->fps = 30;
     gui->zoom = 2;
     gui->pad = 8;
@@ -138,7 +178,9 @@ gui_t *gui_new()
     //     n->chn = i + 1;
     // }
 
-    ecl_set_output(gui->ecl, &midi_output, &gui);
+    gui->outputs = outputs_new();
+    outputs_add(gui->outputs, &midi_sink);
+    ecl_set_output_batch(gui->ecl, &outputs_send, gui->outputs);
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
@@ -168,19 +210,12 @@ gui_t *gui_new()
     {
         error("Texture", SDL_GetError());
     }
-    gui->clip = malloc(gui->hor * gui->ver * sizeof(char));
-    gui->pixels = (Uint32 *)malloc(gui->width * gui->height * sizeof(Uint32));
-    if (!gui->pixels)
+    gui->clip = block_new();
+    gui->canvas = canvas_new(gui->hor, gui->ver, gui->pad);
+    if (!gui->canvas)
     {
         error("Pixels", "Failed to allocate memory");
     }
-    for (i = 0; i < gui->height; i++)
-    {
-        for (j = 0; j < gui->width; j++)
-        {
-            gui->pixels[i * gui->width + j] = COLOR_BLACK;
-        }
-    }
 
     /* Now init midi */
     gui->device = 1;
@@ -220,25 +255,26 @@ void gui_free(gui_t *gui)
         SDL_DestroyWindow(gui->window);
         SDL_Quit();
         ecl_free(gui->ecl);
+        timeline_free(gui->timeline);
+        journal_free(gui->journal);
+        outputs_free(gui->outputs);
+        remote_free(gui->remote);
+        free(gui->hits);
         //free(gui->voices);
-        free(gui->clip);
-        free(gui->pixels);
+        block_free(gui->clip);
+        canvas_free(gui->canvas);
         free(gui);
     }
 }
 
-void put_pixel(gui_t *gui, int x, int y, int color)
-{
-    if (x >= 0 && x < gui->width - 8 && y >= 0 && y < gui->height - 8)
-        gui->pixels[(y + gui->pad) * gui->width + (x + gui->pad)] = theme[color];
-}
-
 void do_insert(gui_t *gui, char c)
 {
     printf("x %d, y %d, c %c\n", gui->cursor.x, gui->cursor.y, c);
     int pos = (gui->cursor.x * gui->ver) + gui->cursor.y;
     printf("insert %d\n", pos);
-    ecl_set(gui->ecl, pos, c);
+    journal_begin(gui->journal);
+    journal_set(gui->journal, gui->ecl, pos, c);
+    journal_end(gui->journal, gui->ecl);
 }
 
 void do_zoom(gui_t *gui, int mod)
@@ -259,99 +295,103 @@ int selected(gui_t *gui, int x, int y)
            y >= gui->cursor.y;
 }
 
-/* TODO: rewrite */
-int get_font(int x, int y, char c, int type, int sel)
+/* Fold the tick just evaluated into the overlay; an exponential moving sum
+   so old activity fades out over about HEATMAP_WINDOW ticks */
+void heatmap_update(gui_t *gui)
 {
+    ecl_t *ecl = gui->ecl;
+    const ecl_stats_t *stats = ecl_stats(ecl);
+    const ecl_event_t *events;
+    float w, decay = 1.0f - 1.0f / HEATMAP_WINDOW;
+    int i, c, n;
 
-    if (valid_char(c))
+    if (!gui->heatmap)
     {
-        return c;
+        return;
     }
-    else if (x % 8 == 0 && y % 8 == 0)
+    if (gui->nhits != ecl->memsz)
     {
-        return '+';
+        free(gui->hits);
+        gui->hits = calloc(ecl->memsz, sizeof(float));
+        gui->nhits = gui->hits ? ecl->memsz : 0;
     }
-    else if (sel || type || (x % 2 == 0 && y % 2 == 0))
+    for (i = 0; i < gui->nhits; i++)
     {
-        return '.';
+        gui->hits[i] *= decay;
     }
-    printf("Unhandled %c\n", c);
-    return c;
-}
-
-/* TODO: rewrite */
-int get_style(int clr, int type, int sel)
-{
-    if (sel)
-        return clr == 0 ? 4 : 0;
-    if (type == 2)
-        return clr == 0 ? 0 : 1;
-    if (type == 3)
-        return clr == 0 ? 1 : 0;
-    if (type == 4)
-        return clr == 0 ? 0 : 2;
-    if (type == 5)
-        return clr == 0 ? 2 : 0;
-    return clr == 0 ? 0 : 3;
-}
-
-void draw_tile(gui_t *gui, int x, int y, char c, int type)
-{
-    int v, h;
-
-    int sel = selected(gui, x, y);
-    Uint8 *bitmap = font[get_font(x, y, c, type, sel)];
-
-    for (v = 0; v < 8; v++)
+    if (gui->heatmap == HEATMAP_EVENTS)
     {
-        for (h = 0; h < 8; h++)
+        events = ecl_events(ecl, &n);
+        for (i = 0; i < n && events[i].x < gui->nhits; i++)
         {
-            int style = get_style((bitmap[v] & 1 << h), type, sel);
-            put_pixel(gui, x * 8 + h, y * 8 + v, style);
+            gui->hits[events[i].x] += 1.0f;
         }
+        return;
+    }
+    for (i = 0; i < gui->nhits; i++)
+    {
+        if (ecl_get_fired(ecl, i) != ecl->clock - 1)
+        {
+            continue;
+        }
+        w = 1.0f;
+        c = ecl->mem[i] & 127;
+        if (gui->heatmap == HEATMAP_COST && stats->cycles[c])
+        { /* only counted in ECL_PROFILE builds */
+            w = (float)stats->cycles[c] / stats->fires[c];
+        }
+        gui->hits[i] += w;
     }
 }
 
 void gui_draw(gui_t *gui)
 {
-    int i, x, y, state, style;
-    // 1 is faint = TYPE_EMPTY
-    // 2 is regular, but turquoise  = TYPE_ARGS
-    // 3 is bold = TYPE_COMMAND
-    // 4 is regular = TYPE_NUMBER
-    // 5 is inverted = TYPE_OUPUT
+    int i, x, y;
+    float max = 0;
 
     for (y = 0; y < gui->hor; y++)
     {
         for (x = 0; x < gui->ver; x++)
         {
             i = y * gui->ver + x;
-            state = ecl_get_state(gui->ecl, i);
-            switch (state)
+            canvas_tile(gui->canvas, y, x, ecl_get(gui->ecl, i), canvas_style(gui->ecl, i),
+                        selected(gui, y, x));
+        }
+    }
+    if (gui->heatmap && gui->nhits == gui->ecl->memsz)
+    {
+        for (i = 0; i < gui->nhits; i++)
+        {
+            max = gui->hits[i] > max ? gui->hits[i] : max;
+        }
+        for (i = 0; max > 0 && i < gui->nhits; i++)
+        {
+            if (gui->hits[i] > 0)
             {
-            case STATE_CMD:
-                style = 3;
-                break;
-            case STATE_NUM:
-            case STATE_ARG:
-            case STATE_NEW:
-                style = 2;
-                break;
-                /// 5?
-            case STATE_EMPTY:
-            default:
-                style = 1;
-                break;
+                canvas_tint(gui->canvas, i / gui->ver, i % gui->ver, gui->hits[i] / max);
             }
-            draw_tile(gui, y, x, ecl_get(gui->ecl, i), style);
         }
     }
-    SDL_UpdateTexture(gui->texture, NULL, gui->pixels, gui->width * sizeof(Uint32));
+    SDL_UpdateTexture(gui->texture, NULL, gui->canvas->pixels, gui->width * sizeof(Uint32));
     SDL_RenderClear(gui->renderer);
     SDL_RenderCopy(gui->renderer, gui->texture, NULL, NULL);
     SDL_RenderPresent(gui->renderer);
 }
 
+/* Step the memory by delta ticks, replaying recorded history where we have it.
+   Random draws replay as recorded; macro instances are not rewound. */
+void do_seek(gui_t *gui, int delta)
+{
+    int tick = gui->ecl->clock + delta;
+
+    if (!timeline_seek(gui->timeline, gui->ecl, tick) && delta > 0)
+    {
+        ecl_eval(gui->ecl);
+        timeline_record(gui->timeline, gui->ecl);
+    }
+    gui_draw(gui);
+}
+
 void do_select(gui_t *gui, int x, int y, int w, int h)
 {
     gui->cursor.x = clamp(x, 0, gui->hor - 1);
@@ -376,61 +416,91 @@ int get_cell(gui_t *gui, int x, int y)
 //     return y + (x * gui->ver);
 // }
 
+/* Share the clipboard with other programs as text */
+static void export_clip(gui_t *gui)
+{
+    char *text = block_to_text(gui->clip);
+
+    if (text)
+    {
+        SDL_SetClipboardText(text);
+        free(text);
+    }
+}
+
 void copy_clip(gui_t *gui)
 {
-    int x, y, i = 0;
+    rect_t *c = &gui->cursor;
 
-    printf("cursor x %d, y %d\n", gui->cursor.x, gui->cursor.y);
-    for (x = 0; x < gui->cursor.w; x++)
+    if (block_copy(gui->clip, gui->ecl, c->x, c->y, c->w, c->h))
     {
-        for (y = 0; y < gui->cursor.h; y++)
-        {
-            gui->clip[i++] = ecl_get(gui->ecl, get_cell(gui, gui->cursor.x + x, gui->cursor.y + y));
-        }
-        gui->clip[i++] = '\n';
+        export_clip(gui);
     }
-    gui->clip[i] = 0;
     gui_draw(gui);
 }
 
 void paste_clip(gui_t *gui)
 {
-    int i = 0, x, y;
-    char ch;
+    char *text;
 
-    x = gui->cursor.x;
-    y = gui->cursor.y;
-    while ((ch = gui->clip[i++]))
-    {
-        if (ch == '\n')
-        {
-            // x = gui->cursor.x;
-            // y++;
-            y = gui->cursor.y;
-            x++;
-        }
-        else
-        {
-            ecl_set(gui->ecl, get_cell(gui, x, y), ch);
-            //x++;
-            y++;
-        }
+    if (SDL_HasClipboardText())
+    { /* may have been copied elsewhere */
+        text = SDL_GetClipboardText();
+        block_from_text(gui->clip, text);
+        SDL_free(text);
     }
+    block_paste(gui->clip, gui->journal, gui->ecl, gui->cursor.x, gui->cursor.y);
     gui_draw(gui);
 }
 
 void cut_clip(gui_t *gui)
 {
-    int x, y;
+    rect_t *c = &gui->cursor;
 
-    copy_clip(gui);
-
-    for (x = 0; x < gui->cursor.w; x++)
-        for (y = 0; y < gui->cursor.h; y++)
-            ecl_set(gui->ecl, get_cell(gui, gui->cursor.x + x, gui->cursor.y + y), '.');
+    if (block_cut(gui->clip, gui->journal, gui->ecl, c->x, c->y, c->w, c->h))
+    {
+        export_clip(gui);
+    }
     gui_draw(gui);
 }
 
+/* Move the selected cells and the selection with them */
+void move_selection(gui_t *gui, int dx, int dy)
+{
+    rect_t *c = &gui->cursor;
+
+    block_move(gui->journal, gui->ecl, c->x, c->y, c->w, c->h, dx, dy);
+    do_move(gui, dx, dy);
+}
+
+/* Turn the selected cells a quarter clockwise, or mirror them */
+void transform_selection(gui_t *gui, int rotate, int vertical)
+{
+    block_t b = {0, 0, 0, 0};
+    rect_t *c = &gui->cursor;
+    int side = c->w > c->h ? c->w : c->h;
+
+    if (!block_copy(&b, gui->ecl, c->x, c->y, c->w, c->h))
+    {
+        return;
+    }
+    if (rotate)
+    {
+        block_rotate(&b);
+    }
+    else
+    {
+        block_flip(&b, vertical);
+    }
+    journal_begin(gui->journal);
+    journal_touch_rect(gui->journal, gui->ecl, c->x, c->y, side, side);
+    block_fill(0, gui->ecl, c->x, c->y, c->w, c->h, '.');
+    block_paste(&b, 0, gui->ecl, c->x, c->y);
+    journal_end(gui->journal, gui->ecl);
+    free(b.cells);
+    do_select(gui, c->x, c->y, b.w, b.h);
+}
+
 static void gui_scankey(gui_t *gui, SDL_Event *event)
 {
     int shift = SDL_GetModState() & KMOD_LSHIFT || SDL_GetModState() & KMOD_RSHIFT;
@@ -450,6 +520,41 @@ static void gui_scankey(gui_t *gui, SDL_Event *event)
         case SDLK_v:
             paste_clip(gui);
             break;
+        case SDLK_z:
+            if (shift)
+                journal_redo(gui->journal, gui->ecl);
+            else
+                journal_undo(gui->journal, gui->ecl);
+            gui_draw(gui);
+            break;
+        case SDLK_y:
+            journal_redo(gui->journal, gui->ecl);
+            gui_draw(gui);
+            break;
+        case SDLK_r:
+            transform_selection(gui, 1, 0);
+            break;
+        case SDLK_f: /* left to right, top to bottom with shift */
+            transform_selection(gui, 0, shift);
+            break;
+        case SDLK_UP:
+            move_selection(gui, 0, -1);
+            break;
+        case SDLK_DOWN:
+            move_selection(gui, 0, 1);
+            break;
+        case SDLK_LEFT:
+            move_selection(gui, -1, 0);
+            break;
+        case SDLK_RIGHT:
+            move_selection(gui, 1, 0);
+            break;
+        case SDLK_h:
+            gui->heatmap = (gui->heatmap + 1) % HEATMAP_MODES;
+            gui->nhits = 0; /* start the window over */
+            printf("heatmap %s\n", heatmap_names[gui->heatmap]);
+            gui_draw(gui);
+            break;
         default:
             break;
         }
@@ -469,6 +574,14 @@ static void gui_scankey(gui_t *gui, SDL_Event *event)
         case SDLK_SPACE:
             gui->pause = !gui->pause;
             break;
+        case SDLK_LEFTBRACKET:
+            gui->pause = 1;
+            do_seek(gui, -1);
+            break;
+        case SDLK_RIGHTBRACKET:
+            gui->pause = 1;
+            do_seek(gui, 1);
+            break;
         case SDLK_ESCAPE:
             do_select(gui, 0, 0, 1, 1);
             break;
@@ -490,6 +603,11 @@ static void gui_scankey(gui_t *gui, SDL_Event *event)
         case SDLK_BACKSPACE:
             do_insert(gui, 0);
             break;
+        case SDLK_DELETE:
+            block_fill(gui->journal, gui->ecl, gui->cursor.x, gui->cursor.y,
+                       gui->cursor.w, gui->cursor.h, '.');
+            gui_draw(gui);
+            break;
         case SDLK_0:
             do_insert(gui, '0');
             break;
@@ -675,11 +793,17 @@ void gui_loop(gui_t *gui)
         if (!gui->pause && tickrun >= 8)
         {
             ecl_eval(gui->ecl);
+            timeline_record(gui->timeline, gui->ecl);
+            heatmap_update(gui);
             run_midi(gui);
             gui_draw(gui);
             tickrun = 0;
         }
         tickrun++;
+        if (remote_tick(gui->remote, gui->ecl))
+        {
+            gui_draw(gui);
+        }
 
         while (SDL_PollEvent(&event) != 0 && !quit)
         {
@@ -711,8 +835,12 @@ void gui_loop(gui_t *gui)
 
 int main(int argc, char **argv)
 {
-    int i;
-    const char *fn = 0;
+    int i, nouts = 0, nlayers = 0, nmacros = 0, nclocks = 0, hor = 32, ver = 48, stats = 0;
+    const char *fn = 0, *remote = 0;
+    const char *outs[OUTPUT_MAX_SINKS];
+    const char *layers[MAX_LAYERS];
+    const char *macros[BASE36];
+    const char *clocks[ECL_CLOCKS];
     gui_t *gui;
 
     for (i = 1; i < argc; i++)
@@ -724,8 +852,81 @@ int main(int argc, char **argv)
                 fn = argv[++i];
             }
         }
+        else if (!strcmp(argv[i], "-o")) /* udp:host:port, shm:path or file:path */
+        {
+            if (i < argc - 1 && nouts < OUTPUT_MAX_SINKS - 1)
+            {
+                outs[nouts++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-c")) /* columns on a clock of their own, id=col,cols,mul/div */
+        {
+            if (i < argc - 1 && nclocks < ECL_CLOCKS)
+            {
+                clocks[nclocks++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-k")) /* macro run by K cells, id=path */
+        {
+            if (i < argc - 1 && nmacros < BASE36)
+            {
+                macros[nmacros++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-l")) /* module file laid over the grid, path@x,y */
+        {
+            if (i < argc - 1 && nlayers < MAX_LAYERS)
+            {
+                layers[nlayers++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-w")) /* grid columns */
+        {
+            if (i < argc - 1)
+            {
+                hor = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], "-h")) /* grid rows */
+        {
+            if (i < argc - 1)
+            {
+                ver = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], "-s")) /* print counters every n ticks */
+        {
+            if (i < argc - 1)
+            {
+                stats = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], "-r")) /* unix socket path or tcp:port */
+        {
+            if (i < argc - 1)
+            {
+                remote = argv[++i];
+            }
+        }
+    }
+    if (hor < 1 || ver < 1)
+    {
+        printf("Invalid grid size %dx%d\n", hor, ver);
+        return 1;
+    }
+    gui = gui_new(hor, ver);
+    ecl_stats_every(gui->ecl, stats, stdout);
+    for (i = 0; i < nouts; i++)
+    {
+        if (!outputs_add(gui->outputs, output_parse(outs[i])))
+        {
+            printf("Failed to open output %s\n", outs[i]);
+        }
+    }
+    if (remote)
+    {
+        gui->remote = remote_new(remote);
     }
-    gui = gui_new();
     if (fn)
     {
         FILE *file = fopen(fn, "r");
@@ -735,6 +936,28 @@ int main(int argc, char **argv)
         }
         fclose(file);
     }
+    for (i = 0; i < nclocks; i++)
+    {
+        if (!ecl_clock_spec(gui->ecl, clocks[i]))
+        {
+            printf("Bad clock %s\n", clocks[i]);
+        }
+    }
+    for (i = 0; i < nmacros; i++)
+    {
+        if (!macro_load(gui->ecl, macros[i]))
+        {
+            printf("Failed to load macro %s\n", macros[i]);
+        }
+    }
+    for (i = 0; i < nlayers; i++)
+    {
+        if (!ecl_load_module(gui->ecl, layers[i]))
+        {
+            printf("Failed to load layer %s\n", layers[i]);
+        }
+    }
+    timeline_record(gui->timeline, gui->ecl);
     gui_loop(gui);
     gui_free(gui);
     return 0;
@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ecl.h"
+#include "macro.h"
+#include "output.h"
+#include "remote.h"
+
+#define MAX_LAYERS 16
+
+/* ECL without a window: runs a memory at a fixed rate, driven and observed
+   through the remote protocol and output sinks */
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    quit = 1;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Load a program, reporting how fast it loaded */
+static void load(ecl_t *ecl, const char *fn)
+{
+    struct stat st;
+    double t0, t;
+    int fd = open(fn, O_RDONLY);
+
+    t0 = seconds();
+    if (fd < 0 || fstat(fd, &st) || !ecl_load_fd(ecl, fd))
+    {
+        printf("Failed to load %s\n", fn);
+    }
+    else
+    {
+        t = seconds() - t0;
+        printf("loaded %s: %ld bytes in %.1f ms, %.1f MB/s\n", fn, (long)st.st_size,
+               t * 1e3, t > 0 ? st.st_size / t / 1e6 : 0.0);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int i, nouts = 0, nlayers = 0, nmacros = 0, nclocks = 0, period = 250, hor = 32, ver = 48, stats = 0, wide = 0;
+    const char *fn = 0, *addr = "/tmp/ecl.sock";
+    const char *outs[OUTPUT_MAX_SINKS];
+    const char *layers[MAX_LAYERS];
+    const char *macros[BASE36];
+    const char *clocks[ECL_CLOCKS];
+    struct timespec next;
+    struct sigaction sa;
+    outputs_t *outputs;
+    remote_t *remote;
+    ecl_t *ecl;
+
+    for (i = 1; i < argc - 1; i++)
+    {
+        if (!strcmp(argv[i], "-f"))
+        {
+            fn = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-c")) /* columns on a clock of their own, id=col,cols,mul/div */
+        {
+            if (nclocks < ECL_CLOCKS)
+            {
+                clocks[nclocks++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-k")) /* macro run by K cells, id=path */
+        {
+            if (nmacros < BASE36)
+            {
+                macros[nmacros++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-l")) /* module file laid over the grid, path@x,y */
+        {
+            if (nlayers < MAX_LAYERS)
+            {
+                layers[nlayers++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-r")) /* unix socket path or tcp:port */
+        {
+            addr = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-w")) /* grid columns */
+        {
+            hor = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-h")) /* grid rows */
+        {
+            ver = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-s")) /* print counters every n ticks */
+        {
+            stats = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-W")) /* 1 for wide values */
+        {
+            wide = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t")) /* milliseconds per tick */
+        {
+            period = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-o")) /* udp:host:port, shm:path or file:path */
+        {
+            if (nouts < OUTPUT_MAX_SINKS)
+            {
+                outs[nouts++] = argv[++i];
+            }
+        }
+    }
+    if (period < 1)
+    {
+        period = 1;
+    }
+    if (hor < 1 || ver < 1)
+    {
+        printf("Invalid grid size %dx%d\n", hor, ver);
+        return 1;
+    }
+
+    ecl = ecl_new(hor, ver, (unsigned long)42);
+    if (wide && !ecl_set_wide(ecl, 1))
+    {
+        printf("Out of memory\n");
+    }
+    outputs = outputs_new();
+    for (i = 0; i < nouts; i++)
+    {
+        if (!outputs_add(outputs, output_parse(outs[i])))
+        {
+            printf("Failed to open output %s\n", outs[i]);
+        }
+    }
+    ecl_set_output_batch(ecl, &outputs_send, outputs);
+    ecl_stats_every(ecl, stats, stdout);
+    if (fn)
+    {
+        load(ecl, fn);
+    }
+    for (i = 0; i < nclocks; i++)
+    {
+        if (!ecl_clock_spec(ecl, clocks[i]))
+        {
+            printf("Bad clock %s\n", clocks[i]);
+        }
+    }
+    for (i = 0; i < nmacros; i++)
+    {
+        if (!macro_load(ecl, macros[i]))
+        {
+            printf("Failed to load macro %s\n", macros[i]);
+        }
+    }
+    for (i = 0; i < nlayers; i++)
+    {
+        if (!ecl_load_module(ecl, layers[i]))
+        {
+            printf("Failed to load layer %s\n", layers[i]);
+        }
+    }
+    remote = remote_new(addr);
+    if (!remote)
+    {
+        outputs_free(outputs);
+        ecl_free(ecl);
+        return 1;
+    }
+    printf("listening on %s\n", addr);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!quit)
+    {
+        ecl_eval(ecl);
+        remote_tick(remote, ecl);
+
+        next.tv_nsec += (long)(period % 1000) * 1000000;
+        next.tv_sec += period / 1000 + next.tv_nsec / 1000000000;
+        next.tv_nsec %= 1000000000;
+        while (!quit && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0))
+        {
+        }
+    }
+
+    remote_free(remote);
+    outputs_free(outputs);
+    ecl_free(ecl);
+    return 0;
+}
@@ -0,0 +1,375 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "journal.h"
+
+/* A touched cell at address x, or with w set a w by h rectangle at column
+   x, row y whose cells before and after are kept in the data pool. In wide
+   memory the values of the cells, before then after, go to the values
+   pool. */
+typedef struct
+{
+    int x, y, w, h;
+    int data;   /* data pool size when the entry was made */
+    int values; /* values pool size when the entry was made */
+    int wide;   /* values were kept */
+    char before, after;
+} entry_t;
+
+struct journal_t
+{
+    entry_t *entries;
+    int nentries, max_entries;
+    char *data; /* rectangle cells, before then after */
+    int ndata, max_data;
+    int *values; /* wide values of touched cells, before then after */
+    int nvalues, max_values;
+    int *edits; /* first entry of each edit */
+    int nedits, max_edits,
+        cur,  /* edits currently applied; the rest can be redone */
+        open; /* inside journal_begin/journal_end */
+};
+
+/* Make room for need elements of size; returns the (possibly moved) buffer
+   or null when out of memory, leaving buf untouched */
+static void *grow(void *buf, int *max, int need, size_t size)
+{
+    void *p;
+    int n;
+
+    if (need <= *max)
+    {
+        return buf;
+    }
+    n = *max ? *max : 64;
+    while (n < need)
+    {
+        n *= 2;
+    }
+    p = realloc(buf, n * size);
+    if (p)
+    {
+        *max = n;
+    }
+    return p;
+}
+
+/* Index one past the last entry of edit i */
+static int edit_end(journal_t *j, int i)
+{
+    return (i + 1 < j->nedits) ? j->edits[i + 1] : j->nentries;
+}
+
+/* Drop the entries from n on, and their rectangle cells */
+static void drop_entries(journal_t *j, int n)
+{
+    if (n < j->nentries)
+    {
+        j->ndata = j->entries[n].data;
+        j->nvalues = j->entries[n].values;
+        j->nentries = n;
+    }
+}
+
+journal_t *journal_new(void)
+{
+    return calloc(1, sizeof(journal_t));
+}
+
+void journal_free(journal_t *j)
+{
+    if (j)
+    {
+        free(j->entries);
+        free(j->edits);
+        free(j->data);
+        free(j->values);
+        free(j);
+    }
+}
+
+void journal_begin(journal_t *j)
+{
+    int *edits;
+
+    if (!j || j->open)
+    {
+        return;
+    }
+    edits = grow(j->edits, &j->max_edits, j->nedits + 1, sizeof(int));
+    if (!edits)
+    {
+        return;
+    }
+    j->edits = edits;
+    j->edits[j->nedits++] = j->nentries;
+    j->open = 1;
+}
+
+/* Append an entry, or return null when out of memory */
+static entry_t *add_entry(journal_t *j)
+{
+    entry_t *e = grow(j->entries, &j->max_entries, j->nentries + 1, sizeof(entry_t));
+
+    if (!e)
+    {
+        return 0;
+    }
+    j->entries = e;
+    e = &j->entries[j->nentries++];
+    memset(e, 0, sizeof(*e));
+    e->data = j->ndata;
+    e->values = j->nvalues;
+    return e;
+}
+
+/* Make room for the 2 * n values of an entry about to be added; returns 0
+   when out of memory */
+static int reserve_values(journal_t *j, int n)
+{
+    int *values = grow(j->values, &j->max_values, j->nvalues + 2 * n, sizeof(int));
+
+    if (!values)
+    {
+        return 0;
+    }
+    j->values = values;
+    return 1;
+}
+
+/* Memory position of address x, wrapped like ecl_get */
+static int cell(ecl_t *ecl, int x)
+{
+    return (unsigned int)x < (unsigned int)ecl->memsz ? x : abs(x) % ecl->memsz;
+}
+
+/* Copy the wide values of the w by h rectangle at column x, row y, or put
+   them back with put set; cells outside memory are skipped */
+static void rect_values(ecl_t *ecl, int x, int y, int w, int h, int *v, int put)
+{
+    int col, row, i;
+
+    for (col = 0; col < w; col++)
+    {
+        for (row = 0; row < h; row++, v++)
+        {
+            if (x + col < 0 || x + col >= ecl->width || y + row < 0 || y + row >= ecl->height)
+            {
+                continue;
+            }
+            i = (x + col) * ecl->height + y + row;
+            if (put)
+            {
+                ecl->wide[i] = *v;
+            }
+            else
+            {
+                *v = ecl->wide[i];
+            }
+        }
+    }
+}
+
+void journal_touch(journal_t *j, ecl_t *ecl, int x)
+{
+    entry_t *e;
+
+    if (!j || !j->open || !ecl || (ecl->wide && !reserve_values(j, 1)) || !(e = add_entry(j)))
+    {
+        return;
+    }
+    e->x = x;
+    e->before = ecl_get(ecl, x);
+    e->after = e->before;
+    if (ecl->wide)
+    {
+        e->wide = 1;
+        j->values[j->nvalues] = ecl->wide[cell(ecl, x)];
+        j->values[j->nvalues + 1] = j->values[j->nvalues];
+        j->nvalues += 2;
+    }
+}
+
+void journal_touch_rect(journal_t *j, ecl_t *ecl, int x, int y, int w, int h)
+{
+    char *data;
+    entry_t *e;
+    int n;
+
+    if (!j || !j->open || !ecl || w < 1 || h < 1 || w > INT_MAX / 2 / h)
+    {
+        return;
+    }
+    n = w * h;
+    data = grow(j->data, &j->max_data, j->ndata + 2 * n, 1);
+    if (!data)
+    {
+        return;
+    }
+    j->data = data;
+    if ((ecl->wide && !reserve_values(j, n)) || !(e = add_entry(j)))
+    {
+        return;
+    }
+    e->x = x;
+    e->y = y;
+    e->w = w;
+    e->h = h;
+    ecl_extract(ecl, x, y, w, h, j->data + e->data);
+    j->ndata += 2 * n;
+    if (ecl->wide)
+    {
+        e->wide = 1;
+        memset(j->values + e->values, 0, 2 * n * sizeof(int));
+        rect_values(ecl, x, y, w, h, j->values + e->values, 0);
+        j->nvalues += 2 * n;
+    }
+}
+
+void journal_set(journal_t *j, ecl_t *ecl, int x, char val)
+{
+    journal_touch(j, ecl, x);
+    ecl_set(ecl, x, val);
+}
+
+/* Move the last edit, which follows edits that were undone, in place of
+   the first of them, dropping them and their pool space */
+static void fork_history(journal_t *j)
+{
+    int i, first = j->edits[j->cur], last = j->edits[j->nedits - 1];
+    int data = j->entries[last].data - j->entries[first].data;
+    int values = j->entries[last].values - j->entries[first].values;
+
+    if (data)
+    {
+        memmove(j->data + j->entries[first].data, j->data + j->entries[last].data,
+                j->ndata - j->entries[last].data);
+    }
+    if (values)
+    {
+        memmove(j->values + j->entries[first].values, j->values + j->entries[last].values,
+                (j->nvalues - j->entries[last].values) * sizeof(int));
+    }
+    memmove(j->entries + first, j->entries + last, (j->nentries - last) * sizeof(entry_t));
+    j->nentries -= last - first;
+    j->ndata -= data;
+    j->nvalues -= values;
+    for (i = first; i < j->nentries; i++)
+    {
+        j->entries[i].data -= data;
+        j->entries[i].values -= values;
+    }
+    j->nedits = j->cur + 1;
+}
+
+void journal_end(journal_t *j, ecl_t *ecl)
+{
+    int i, n, changed = 0;
+    entry_t *e;
+
+    if (!j || !j->open)
+    {
+        return;
+    }
+    j->open = 0;
+    for (i = j->edits[j->nedits - 1]; i < j->nentries; i++)
+    {
+        e = &j->entries[i];
+        n = e->w ? e->w * e->h : 1;
+        if (e->wide && ecl->wide)
+        {
+            memcpy(j->values + e->values + n, j->values + e->values, n * sizeof(int));
+            if (e->w)
+            {
+                rect_values(ecl, e->x, e->y, e->w, e->h, j->values + e->values + n, 0);
+            }
+            else
+            {
+                j->values[e->values + 1] = ecl->wide[cell(ecl, e->x)];
+            }
+            changed |= memcmp(j->values + e->values, j->values + e->values + n, n * sizeof(int)) != 0;
+        }
+        if (e->w)
+        {
+            ecl_extract(ecl, e->x, e->y, e->w, e->h, j->data + e->data + n);
+            changed |= memcmp(j->data + e->data, j->data + e->data + n, n) != 0;
+            continue;
+        }
+        e->after = ecl_get(ecl, e->x);
+        changed |= e->after != e->before;
+    }
+    if (!changed)
+    { /* what could be redone still can */
+        drop_entries(j, j->edits[--j->nedits]);
+        return;
+    }
+    if (j->cur < j->nedits - 1)
+    { /* a new edit forks history; drop the redo tail */
+        fork_history(j);
+    }
+    j->cur = j->nedits;
+}
+
+/* Put back the cells of an entry as they were before or after the edit */
+static void apply(journal_t *j, ecl_t *ecl, const entry_t *e, int after)
+{
+    int n = e->w ? e->w * e->h : 1;
+    int *values = j->values + e->values + (after ? n : 0);
+
+    if (e->w)
+    {
+        ecl_blit(ecl, e->x, e->y, j->data + e->data + (after ? n : 0), e->w, e->h, 0);
+    }
+    else
+    {
+        ecl_set(ecl, e->x, after ? e->after : e->before);
+    }
+    if (!e->wide || !ecl->wide)
+    {
+        return; /* the glyphs set the values */
+    }
+    if (e->w)
+    {
+        rect_values(ecl, e->x, e->y, e->w, e->h, values, 1);
+    }
+    else
+    {
+        ecl->wide[cell(ecl, e->x)] = *values;
+    }
+}
+
+int journal_undo(journal_t *j, ecl_t *ecl)
+{
+    int i;
+
+    if (!j || j->open || j->cur == 0)
+    {
+        return 0;
+    }
+    j->cur--;
+    /* reverse order so a cell touched twice gets its oldest value */
+    for (i = edit_end(j, j->cur) - 1; i >= j->edits[j->cur]; i--)
+    {
+        apply(j, ecl, &j->entries[i], 0);
+    }
+    return 1;
+}
+
+int journal_redo(journal_t *j, ecl_t *ecl)
+{
+    int i;
+
+    if (!j || j->open || j->cur == j->nedits)
+    {
+        return 0;
+    }
+    for (i = j->edits[j->cur]; i < edit_end(j, j->cur); i++)
+    {
+        apply(j, ecl, &j->entries[i], 1);
+    }
+    j->cur++;
+    return 1;
+}
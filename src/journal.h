@@ -0,0 +1,45 @@
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* Undo/redo history of edits made to an ECL memory. Each edit stores only
+   the cells or rectangles it touched with their values before and after, so
+   memory and undo/redo time are proportional to the size of the edit. In
+   wide memory (see ecl_set_wide) the values of the cells are kept too. */
+typedef struct journal_t journal_t;
+
+/* Create an empty journal */
+journal_t *journal_new(void);
+
+/* Destroy a journal */
+void journal_free(journal_t *j);
+
+/* Start a new edit */
+void journal_begin(journal_t *j);
+
+/* Remember the value at memory position x before the current edit changes it */
+void journal_touch(journal_t *j, ecl_t *ecl, int x);
+
+/* Remember the w by h rectangle at column x, row y before the current edit
+   changes it; cheaper than touching each cell for block edits */
+void journal_touch_rect(journal_t *j, ecl_t *ecl, int x, int y, int w, int h);
+
+/* Set the value at memory position x as part of the current edit */
+void journal_set(journal_t *j, ecl_t *ecl, int x, char val);
+
+/* Finish the current edit. One that changed nothing is dropped and leaves
+   the history as it was; otherwise anything that could be redone is
+   discarded */
+void journal_end(journal_t *j, ecl_t *ecl);
+
+/* Revert the last edit; returns non-zero if there was one */
+int journal_undo(journal_t *j, ecl_t *ecl);
+
+/* Reapply the last reverted edit; returns non-zero if there was one */
+int journal_redo(journal_t *j, ecl_t *ecl);
+
+#endif
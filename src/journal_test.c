@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "journal.h"
+
+/* Columns of the w by h rectangle at x, y as one string */
+static const char *region(ecl_t *ecl, int x, int y, int w, int h)
+{
+  static char out[64];
+
+  ecl_extract(ecl, x, y, w, h, out);
+  out[w * h] = '\0';
+  return out;
+}
+
+/* One edit writing cells over the w by h rectangle at x, y */
+static void fill(journal_t *j, ecl_t *ecl, int x, int y, int w, int h, const char *cells)
+{
+  journal_begin(j);
+  journal_touch_rect(j, ecl, x, y, w, h);
+  ecl_blit(ecl, x, y, cells, w, h, 0);
+  journal_end(j, ecl);
+}
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(4, 4, (unsigned long)1);
+  journal_t *j = journal_new();
+  int ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* single cells: each edit is one undo step, a cell set twice in an edit
+     comes back to its first value */
+  journal_begin(j);
+  journal_set(j, ecl, 0, 'A');
+  journal_set(j, ecl, 0, 'B');
+  journal_set(j, ecl, 5, '3');
+  journal_end(j, ecl);
+  journal_begin(j);
+  journal_set(j, ecl, 1, 'C');
+  journal_end(j, ecl);
+  if (!journal_undo(j, ecl) || ecl_get(ecl, 1) != '.' || ecl_get(ecl, 0) != 'B')
+  {
+    printf("journal: bad undo of the second edit\n");
+    ok = 0;
+  }
+  if (!journal_undo(j, ecl) || ecl_get(ecl, 0) != '.' || ecl_get(ecl, 5) != '.' ||
+      journal_undo(j, ecl))
+  {
+    printf("journal: bad undo of the first edit\n");
+    ok = 0;
+  }
+  if (!journal_redo(j, ecl) || !journal_redo(j, ecl) || journal_redo(j, ecl) ||
+      ecl_get(ecl, 0) != 'B' || ecl_get(ecl, 5) != '3' || ecl_get(ecl, 1) != 'C')
+  {
+    printf("journal: bad redo\n");
+    ok = 0;
+  }
+
+  /* rectangles keep their cells before and after */
+  fill(j, ecl, 1, 1, 2, 2, "1234");
+  fill(j, ecl, 2, 0, 2, 3, "abcdef");
+  journal_undo(j, ecl);
+  if (strcmp(region(ecl, 1, 1, 2, 2), "1234") || strcmp(region(ecl, 2, 0, 2, 3), ".34..."))
+  {
+    printf("journal: bad rectangle undo %s\n", region(ecl, 2, 0, 2, 3));
+    ok = 0;
+  }
+  journal_redo(j, ecl);
+  if (strcmp(region(ecl, 2, 0, 2, 3), "abcdef"))
+  {
+    printf("journal: bad rectangle redo %s\n", region(ecl, 2, 0, 2, 3));
+    ok = 0;
+  }
+
+  /* an edit that changes nothing leaves what can be redone */
+  journal_undo(j, ecl);
+  journal_undo(j, ecl);
+  fill(j, ecl, 0, 0, 1, 1, "B");
+  journal_begin(j);
+  journal_set(j, ecl, 1, 'C');
+  journal_end(j, ecl);
+  if (!journal_redo(j, ecl) || strcmp(region(ecl, 1, 1, 2, 2), "1234"))
+  {
+    printf("journal: no-op edit dropped the redo history\n");
+    ok = 0;
+  }
+
+  /* a new edit drops it; earlier edits still undo past the new one */
+  journal_undo(j, ecl);
+  fill(j, ecl, 0, 2, 2, 2, "wxyz");
+  if (journal_redo(j, ecl) || strcmp(region(ecl, 0, 2, 2, 2), "wxyz"))
+  {
+    printf("journal: redo after a new edit\n");
+    ok = 0;
+  }
+  if (!journal_undo(j, ecl) || strcmp(region(ecl, 0, 2, 2, 2), "....") ||
+      !journal_undo(j, ecl) || ecl_get(ecl, 1) != '.' ||
+      !journal_redo(j, ecl) || !journal_redo(j, ecl) ||
+      strcmp(region(ecl, 0, 2, 2, 2), "wxyz") || strcmp(region(ecl, 2, 0, 2, 3), "......") ||
+      ecl_get(ecl, 1) != 'C' || ecl_get(ecl, 5) != '3')
+  {
+    printf("journal: bad history after a new edit\n");
+    ok = 0;
+  }
+
+  /* wide values of the edit kept after a fork come back with it */
+  journal_free(j);
+  j = journal_new();
+  ecl_set_wide(ecl, 1);
+  journal_begin(j);
+  journal_touch(j, ecl, 0);
+  ecl_set_num(ecl, 0, 1000);
+  journal_end(j, ecl);
+  journal_begin(j);
+  journal_touch_rect(j, ecl, 1, 0, 1, 2);
+  ecl_set_num(ecl, 4, 2000);
+  journal_end(j, ecl);
+  journal_undo(j, ecl);
+  journal_begin(j);
+  journal_touch_rect(j, ecl, 2, 0, 1, 2);
+  ecl_set_num(ecl, 9, 3000);
+  journal_end(j, ecl);
+  journal_begin(j);
+  journal_touch_rect(j, ecl, 3, 0, 1, 2);
+  ecl_set_num(ecl, 12, 4000);
+  journal_end(j, ecl);
+  journal_undo(j, ecl);
+  journal_undo(j, ecl);
+  journal_undo(j, ecl);
+  journal_redo(j, ecl);
+  journal_redo(j, ecl);
+  journal_redo(j, ecl);
+  if (ecl_get_num(ecl, 0) != 1000 || ecl_get_num(ecl, 4) != 0 || ecl_get_num(ecl, 9) != 3000 ||
+      ecl_get_num(ecl, 12) != 4000)
+  {
+    printf("journal: bad wide values %d %d %d %d\n", ecl_get_num(ecl, 0), ecl_get_num(ecl, 4),
+           ecl_get_num(ecl, 9), ecl_get_num(ecl, 12));
+    ok = 0;
+  }
+
+  journal_free(j);
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "journal ok" : "journal FAILED");
+  return !ok;
+}
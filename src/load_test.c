@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "ecl.h"
+
+#define BIG (8 << 20)
+
+static double seconds(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Make n bytes of program text: lines of varying length, some CRLF */
+static void make_program(char *text, int n)
+{
+  const char *cells = "..1.2A3.G..T4O.";
+  int i, line = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    if (++line > 5000 + i % 977)
+    {
+      text[i] = '\n';
+      if (i % 2 && i + 1 < n)
+      {
+        text[i++] = '\r';
+        text[i] = '\n';
+      }
+      line = 0;
+    }
+    else
+    {
+      text[i] = cells[(i * 7) % 15];
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ecl_t *a = ecl_new(16, 1, (unsigned long)1);
+  ecl_t *b = ecl_new(256, 256, (unsigned long)1);
+  ecl_t *c = ecl_new(256, 256, (unsigned long)1);
+  char *text = malloc(BIG);
+  FILE *file = tmpfile();
+  double t;
+  int ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* CRLF, and a last line without a line end keeps its last cell */
+  ecl_load_buffer(a, "1.2\r\n3\r\n.A", 10, 0);
+  if (memcmp(a->mem, "1.23.A", 6))
+  {
+    printf("load: bad line ends\n");
+    ok = 0;
+  }
+
+  /* offsets wrap around the end of memory */
+  ecl_load_buffer(a, "................45", 18, 0);
+  if (memcmp(a->mem, "45", 2))
+  {
+    printf("load: no wrap\n");
+    ok = 0;
+  }
+
+  /* long lines through a file, split across reads, match one buffer */
+  make_program(text, BIG);
+  t = seconds();
+  ecl_load_buffer(b, text, BIG, 0);
+  t = seconds() - t;
+  fwrite(text, 1, BIG, file);
+  rewind(file);
+  if (!ecl_load(c, file) || memcmp(b->mem, c->mem, b->memsz))
+  {
+    printf("load: file differs from buffer\n");
+    ok = 0;
+  }
+  ecl_reset(c);
+  if (lseek(fileno(file), 0, SEEK_SET) || !ecl_load_fd(c, fileno(file)) ||
+      memcmp(b->mem, c->mem, b->memsz))
+  {
+    printf("load: descriptor differs from buffer\n");
+    ok = 0;
+  }
+  printf("loaded %d MB at %.0f MB/s\n", BIG >> 20, t > 0 ? BIG / t / 1e6 : 0.0);
+
+  fclose(file);
+  free(text);
+  ecl_free(c);
+  ecl_free(b);
+  ecl_free(a);
+
+  printf("%s\n", ok ? "load ok" : "load FAILED");
+  return !ok;
+}
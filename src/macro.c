@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macro.h"
+
+/* An instance and the K that runs it */
+typedef struct
+{
+    int x, id;
+    ecl_t *ecl;
+} instance_t;
+
+typedef struct macro_t
+{
+    ecl_t *defs[BASE36]; /* never evaluated; instances share their program */
+    instance_t *instances;
+    int ninstances, max_instances;
+} macro_t;
+
+static macro_t *macros(ecl_t *ecl)
+{
+    if (!ecl->macros)
+    {
+        ecl->macros = calloc(1, sizeof(macro_t));
+    }
+    return ecl->macros;
+}
+
+/* Drop instance i, keeping the others in order */
+static void drop(macro_t *m, int i)
+{
+    ecl_free(m->instances[i].ecl);
+    memmove(m->instances + i, m->instances + i + 1, (m->ninstances - i - 1) * sizeof(instance_t));
+    m->ninstances--;
+}
+
+int macro_define(ecl_t *ecl, int id, const char *cells, int w, int h)
+{
+    macro_t *m;
+    ecl_t *def;
+    int i;
+
+    if (!ecl || id < 0 || id >= BASE36 || !(m = macros(ecl)))
+    {
+        return 0;
+    }
+    def = ecl_new(w, h, (unsigned long)id);
+    if (!def)
+    {
+        return 0;
+    }
+    ecl_blit(def, 0, 0, cells, w, h, 0);
+    for (i = m->ninstances - 1; i >= 0; i--)
+    {
+        if (m->instances[i].id == id)
+        {
+            drop(m, i);
+        }
+    }
+    ecl_free(m->defs[id]);
+    m->defs[id] = def;
+    return 1;
+}
+
+int macro_load(ecl_t *ecl, const char *spec)
+{
+    FILE *file;
+    char *cells;
+    int w, h, ok;
+
+    if (!((spec[0] >= '0' && spec[0] <= '9') || (spec[0] >= 'a' && spec[0] <= 'z')) ||
+        spec[1] != '=')
+    { /* the id is one base 36 digit */
+        return 0;
+    }
+    file = fopen(spec + 2, "r");
+    cells = ecl_read_region(file, &w, &h);
+    if (file)
+    {
+        fclose(file);
+    }
+    ok = cells && macro_define(ecl, char2int(spec[0]), cells, w, h);
+    free(cells);
+    return ok;
+}
+
+ecl_t *macro_instance(ecl_t *ecl, int x)
+{
+    macro_t *m = ecl->macros;
+    int i;
+
+    for (i = 0; m && i < m->ninstances; i++)
+    {
+        if (m->instances[i].x == x)
+        {
+            return m->instances[i].ecl;
+        }
+    }
+    return 0;
+}
+
+ecl_t *macro_enter(ecl_t *ecl, int x, int id)
+{
+    macro_t *m = ecl->macros;
+    instance_t *grown, *in;
+    int i;
+
+    if (!m || id < 0 || id >= BASE36 || !m->defs[id])
+    {
+        return 0;
+    }
+    i = 0;
+    while (i < m->ninstances && m->instances[i].x < x)
+    {
+        i++;
+    }
+    if (i < m->ninstances && m->instances[i].x == x)
+    {
+        if (m->instances[i].id == id)
+        {
+            in = &m->instances[i];
+            if (ecl->wide && !in->ecl->wide)
+            {
+                ecl_set_wide(in->ecl, 1);
+            }
+            return in->ecl;
+        }
+        drop(m, i); /* the K now names another macro */
+    }
+    if (m->ninstances == m->max_instances)
+    {
+        grown = realloc(m->instances, (m->max_instances ? m->max_instances * 2 : 16) * sizeof(instance_t));
+        if (!grown)
+        {
+            return 0;
+        }
+        m->instances = grown;
+        m->max_instances = m->max_instances ? m->max_instances * 2 : 16;
+    }
+    in = m->instances + i;
+    memmove(in + 1, in, (m->ninstances - i) * sizeof(instance_t));
+    in->x = x;
+    in->id = id;
+    in->ecl = ecl_new_sharing(m->defs[id], (unsigned long)x + 1);
+    if (!in->ecl)
+    {
+        memmove(in, in + 1, (m->ninstances - i) * sizeof(instance_t));
+        return 0;
+    }
+    m->ninstances++;
+    if (ecl->wide)
+    {
+        ecl_set_wide(in->ecl, 1);
+    }
+    return in->ecl;
+}
+
+void macro_prune(ecl_t *ecl)
+{
+    macro_t *m = ecl->macros;
+    int i;
+
+    for (i = m->ninstances - 1; i >= 0; i--)
+    {
+        if (m->instances[i].x >= ecl->memsz || ecl->mem[m->instances[i].x] != 'K')
+        {
+            drop(m, i);
+        }
+    }
+}
+
+void macro_free(ecl_t *ecl)
+{
+    macro_t *m = ecl->macros;
+    int i;
+
+    while (m->ninstances > 0)
+    {
+        drop(m, m->ninstances - 1);
+    }
+    for (i = 0; i < BASE36; i++)
+    {
+        ecl_free(m->defs[i]);
+    }
+    free(m->instances);
+    free(m);
+    ecl->macros = 0;
+}
@@ -0,0 +1,36 @@
+
+#ifndef _MACRO_H_
+#define _MACRO_H_
+
+#include "ecl.h"
+
+/* Macros: a grid defined once under a base 36 id and run by K cells.
+   K<id><param> keeps an instance of the macro: a memory of its own that
+   evaluates with the host every tick from the compiled program of the
+   definition, which all instances share until one of them rewrites its
+   commands. A number above the K is written to the first cell of the
+   instance, param is its variable 0 (read with Q0), and a number reaching
+   the bottom of its last column comes out below K's arguments. Notes its
+   O commands fire join the host's events of the tick as fired by the K. */
+
+/* Define macro id as the w by h cells, column by column, replacing any
+   earlier definition and its instances; returns 0 when out of memory */
+int macro_define(ecl_t *ecl, int id, const char *cells, int w, int h);
+
+/* Define a macro from a program file given as "id=path" */
+int macro_load(ecl_t *ecl, const char *spec);
+
+/* Instance of macro id for the K at x, created on first use; 0 when id is
+   not defined or out of memory. Called by K. */
+ecl_t *macro_enter(ecl_t *ecl, int x, int id);
+
+/* Drop instances whose K is gone; called when memory is recompiled */
+void macro_prune(ecl_t *ecl);
+
+/* Instance of the K at x, or 0 if it has none yet */
+ecl_t *macro_instance(ecl_t *ecl, int x);
+
+/* Destroy all definitions and instances; called by ecl_free */
+void macro_free(ecl_t *ecl);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "macro.h"
+
+static int batches, batched;
+
+static void count(const ecl_event_t *events, int n, int tick, void *ctx)
+{
+  (void)events;
+  (void)tick;
+  (void)ctx;
+  batches++;
+  batched += n;
+}
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(3, 8, (unsigned long)1);
+  ecl_t *a, *b;
+  const ecl_event_t *ev;
+  const char *path = "/tmp/ecl_macro_test.ecl";
+  char spec[64];
+  FILE *file;
+  int n, ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* macro 1 increments its input, macro 2 answers with its parameter */
+  if (!macro_define(ecl, 1, ".I1.", 1, 4) || !macro_define(ecl, 2, ".Q0.", 1, 4))
+  {
+    printf("macro: define failed\n");
+    ok = 0;
+  }
+  ecl_blit(ecl, 0, 0, "5K1.....", 1, 8, 0);
+  ecl_blit(ecl, 1, 0, "5K17....", 1, 8, 0);
+  ecl_blit(ecl, 2, 0, "5K27....", 1, 8, 0);
+  ecl_eval(ecl);
+  ecl_eval(ecl);
+  if (ecl_get(ecl, 0 * 8 + 4) != '6' || ecl_get(ecl, 1 * 8 + 4) != '6' ||
+      ecl_get(ecl, 2 * 8 + 4) != '7')
+  {
+    printf("macro: bad output %c %c %c\n", ecl_get(ecl, 4), ecl_get(ecl, 12), ecl_get(ecl, 20));
+    ok = 0;
+  }
+
+  /* instances of one macro keep their own cells but share its program */
+  a = macro_instance(ecl, 0 * 8 + 1);
+  b = macro_instance(ecl, 1 * 8 + 1);
+  if (!a || !b || a == b || a->prog != b->prog || a->mem == b->mem)
+  {
+    printf("macro: instances not shared\n");
+    ok = 0;
+  }
+
+  /* an instance whose commands change gets a program of its own */
+  ecl_set(b, 1, 'D');
+  ecl_eval(ecl);
+  if (a->prog == b->prog || b->prog[0].op == a->prog[0].op)
+  {
+    printf("macro: edited instance still shared\n");
+    ok = 0;
+  }
+
+  /* removing a K drops its instance */
+  ecl_set(ecl, 2 * 8 + 1, '.');
+  ecl_eval(ecl);
+  if (macro_instance(ecl, 2 * 8 + 1) || !macro_instance(ecl, 0 * 8 + 1))
+  {
+    printf("macro: instance not dropped\n");
+    ok = 0;
+  }
+
+  /* notes of every instance go out in the host's one batch of the tick,
+     from the last K down */
+  macro_define(ecl, 3, ".O11111.", 1, 8);
+  ecl_blit(ecl, 0, 0, "5K3.....", 1, 8, 0);
+  ecl_blit(ecl, 2, 0, "5K3.....", 1, 8, 0);
+  ecl_set_output_batch(ecl, count, 0);
+  ecl_eval(ecl);
+  ev = ecl_events(ecl, &n);
+  if (batches != 1 || batched != 2 || n != 2 || ev[0].x != 2 * 8 + 1 || ev[1].x != 1)
+  {
+    printf("macro: %d batches of %d events\n", batches, batched);
+    ok = 0;
+  }
+
+  /* a file is loaded under a base 36 digit and nothing else */
+  if ((file = fopen(path, "w")))
+  {
+    fputs(".I1.\n", file);
+    fclose(file);
+  }
+  sprintf(spec, "#=%s", path);
+  if (macro_load(ecl, spec) || macro_load(ecl, spec + 1))
+  {
+    printf("macro: loaded %s\n", spec);
+    ok = 0;
+  }
+  sprintf(spec, "z=%s", path);
+  if (!macro_load(ecl, spec))
+  {
+    printf("macro: failed to load %s\n", spec);
+    ok = 0;
+  }
+  remove(path);
+
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "macro ok" : "macro FAILED");
+  return !ok;
+}
@@ -0,0 +1,157 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "delta.h"
+#include "mirror.h"
+
+#define MIRROR_HEADER 5 /* kind, u32 tick */
+#define MIRROR_KEY_HEADER (MIRROR_HEADER + 8)
+
+struct mirror_t
+{
+    unsigned char *prev, /* frame of the last message */
+        *cur,            /* scratch frame */
+        *msg;
+    int framesz,
+        synced; /* prev holds a frame the other side also has */
+};
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/* Size the buffers for frames of n bytes */
+static int resize(mirror_t *m, int n)
+{
+    size_t max = delta_bound(n) + MIRROR_HEADER;
+
+    if (max < (size_t)n + MIRROR_KEY_HEADER)
+    {
+        max = (size_t)n + MIRROR_KEY_HEADER;
+    }
+    free(m->prev);
+    free(m->cur);
+    free(m->msg);
+    m->prev = malloc(n);
+    m->cur = malloc(n);
+    m->msg = malloc(max);
+    m->synced = 0;
+    m->framesz = (m->prev && m->cur && m->msg) ? n : 0;
+    return m->framesz != 0;
+}
+
+mirror_t *mirror_new(void)
+{
+    return calloc(1, sizeof(mirror_t));
+}
+
+void mirror_free(mirror_t *m)
+{
+    if (m)
+    {
+        free(m->prev);
+        free(m->cur);
+        free(m->msg);
+        free(m);
+    }
+}
+
+size_t mirror_encode(mirror_t *m, ecl_t *ecl, int key, const unsigned char **msg)
+{
+    int n = delta_frame_size(ecl);
+    unsigned char *t;
+    size_t len;
+
+    if (!m || (n != m->framesz && !resize(m, n)))
+    {
+        return 0;
+    }
+    delta_capture(ecl, m->cur);
+    put_u32(m->msg + 1, (unsigned int)ecl->clock);
+    if (key || !m->synced)
+    {
+        m->msg[0] = 'K';
+        put_u32(m->msg + MIRROR_HEADER, (unsigned int)ecl->width);
+        put_u32(m->msg + MIRROR_HEADER + 4, (unsigned int)ecl->height);
+        memcpy(m->msg + MIRROR_KEY_HEADER, m->cur, n);
+        len = MIRROR_KEY_HEADER + n;
+    }
+    else
+    {
+        m->msg[0] = 'D';
+        len = MIRROR_HEADER + delta_encode(m->prev, m->cur, n, m->msg + MIRROR_HEADER);
+    }
+    t = m->prev;
+    m->prev = m->cur;
+    m->cur = t;
+    m->synced = 1;
+    *msg = m->msg;
+    return len;
+}
+
+int mirror_decode(mirror_t *m, ecl_t *ecl, const unsigned char *msg, size_t len)
+{
+    int n = delta_frame_size(ecl), wide;
+    unsigned int w, h;
+
+    if (!m || len < MIRROR_HEADER)
+    {
+        return 0;
+    }
+    if (msg[0] == 'K')
+    {
+        if (len < MIRROR_KEY_HEADER)
+        {
+            return 0;
+        }
+        w = get_u32(msg + MIRROR_HEADER);
+        h = get_u32(msg + MIRROR_HEADER + 4);
+        /* the frame size tells whether the sender has wide values */
+        wide = w && h && w <= INT_MAX / 6 / h &&
+               len == MIRROR_KEY_HEADER + (size_t)w * h * 6 + BASE36 * 5;
+        if (w != (unsigned int)ecl->width || h != (unsigned int)ecl->height)
+        { /* follow the sender to its new size */
+            if (w > INT_MAX || h > INT_MAX ||
+                (!wide && len != MIRROR_KEY_HEADER + (size_t)w * h * 2 + BASE36) ||
+                !ecl_resize(ecl, (int)w, (int)h))
+            {
+                return 0;
+            }
+        }
+        if (wide != (ecl->wide != 0) && !ecl_set_wide(ecl, wide))
+        {
+            return 0;
+        }
+        n = delta_frame_size(ecl);
+        if (len != MIRROR_KEY_HEADER + (size_t)n || (n != m->framesz && !resize(m, n)))
+        {
+            return 0;
+        }
+        memcpy(m->prev, msg + MIRROR_KEY_HEADER, n);
+        m->synced = 1;
+    }
+    else if (msg[0] != 'D' || !m->synced || n != m->framesz)
+    {
+        return 0;
+    }
+    else if (!delta_apply(m->prev, n, msg + MIRROR_HEADER, len - MIRROR_HEADER))
+    { /* prev is now garbage; wait for the next keyframe */
+        m->synced = 0;
+        return 0;
+    }
+    delta_restore(ecl, m->prev);
+    ecl->clock = (int)get_u32(msg + 1);
+    return 1;
+}
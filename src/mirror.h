@@ -0,0 +1,37 @@
+
+#ifndef _MIRROR_H_
+#define _MIRROR_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* Mirroring of a running ECL memory, e.g. to remote displays. The sender
+   encodes every tick as a message against the previous one; a receiver that
+   decodes the messages in order reconstructs mem, state, vars and clock
+   bit-exactly, and the size of a message scales with the cells that changed.
+
+   A message is a kind byte and the u32 tick (little-endian), then
+     'K' keyframe: u32 width, u32 height, a full frame (see delta.h)
+     'D' delta:    the delta from the frame of the previous message */
+typedef struct mirror_t mirror_t;
+
+/* Create a mirror; the same type serves as sender or receiver */
+mirror_t *mirror_new(void);
+
+/* Destroy a mirror */
+void mirror_free(mirror_t *m);
+
+/* Encode the current state of ecl. A keyframe is produced when key is
+   non-zero, on the first call and after the memory was resized; otherwise a
+   delta. Returns the message length, 0 when out of memory; *msg stays valid
+   until the next call. */
+size_t mirror_encode(mirror_t *m, ecl_t *ecl, int key, const unsigned char **msg);
+
+/* Apply a message to ecl, the receiver's copy of the memory; a keyframe for
+   a memory of another size resizes ecl. Returns 0 when the message does not
+   apply: malformed, or a delta with no keyframe before it. */
+int mirror_decode(mirror_t *m, ecl_t *ecl, const unsigned char *msg, size_t len);
+
+#endif
@@ -0,0 +1,77 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "mirror.h"
+
+#define TICKS 200
+
+static const char *program =
+    "G11.I1.........."
+    "G31..R.4........"
+    "..G21.$1........"
+    "................";
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(4, 16, 34583);
+  ecl_t *copy = ecl_new(4, 16, 1);
+  mirror_t *tx = mirror_new();
+  mirror_t *rx = mirror_new();
+  const unsigned char *msg;
+  size_t len, total = 0;
+  int t, x, fail = 0;
+
+  (void)argc;
+  (void)argv;
+
+  ecl_load_buffer(ecl, program, strlen(program), 0);
+  for (t = 0; t < TICKS && !fail; t++)
+  {
+    if (t == TICKS / 2)
+    { /* the receiver follows the sender to its new size */
+      ecl_resize(ecl, 6, 12);
+    }
+    len = mirror_encode(tx, ecl, 0, &msg);
+    total += len;
+    if (!mirror_decode(rx, copy, msg, len) || copy->clock != ecl->clock ||
+        copy->width != ecl->width || copy->height != ecl->height ||
+        memcmp(copy->mem, ecl->mem, ecl->memsz) ||
+        memcmp(copy->vars, ecl->vars, sizeof(ecl->vars)))
+    {
+      printf("tick %d does not match\n", t);
+      fail = 1;
+    }
+    for (x = 0; x < ecl->memsz; x++)
+    {
+      if ((unsigned char)copy->state[x] != (unsigned char)ecl->state[x])
+      {
+        printf("tick %d: state of cell %d does not match\n", t, x);
+        fail = 1;
+        break;
+      }
+    }
+    ecl_eval(ecl);
+  }
+  printf("mirrored %d ticks in %lu bytes, %d per full frame\n",
+         TICKS, (unsigned long)total, ecl->memsz * 2 + BASE36);
+
+  /* a delta without a keyframe before it is refused */
+  mirror_free(rx);
+  rx = mirror_new();
+  len = mirror_encode(tx, ecl, 0, &msg);
+  if (msg[0] != 'D' || mirror_decode(rx, copy, msg, len))
+  {
+    printf("delta accepted without a keyframe\n");
+    fail = 1;
+  }
+
+  printf("%s\n", fail ? "mirror FAILED" : "mirror ok");
+  mirror_free(tx);
+  mirror_free(rx);
+  ecl_free(copy);
+  ecl_free(ecl);
+  return fail;
+}
@@ -0,0 +1,352 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ecl.h"
+#include "output.h"
+
+struct outputs_t
+{
+    output_sink_t *sinks[OUTPUT_MAX_SINKS];
+    int nsinks;
+};
+
+outputs_t *outputs_new(void)
+{
+    return calloc(1, sizeof(outputs_t));
+}
+
+void outputs_free(outputs_t *out)
+{
+    int i;
+
+    if (out)
+    {
+        for (i = 0; i < out->nsinks; i++)
+        {
+            out->sinks[i]->free(out->sinks[i]);
+        }
+        free(out);
+    }
+}
+
+int outputs_add(outputs_t *out, output_sink_t *sink)
+{
+    if (!out || !sink || out->nsinks == OUTPUT_MAX_SINKS)
+    {
+        return 0;
+    }
+    out->sinks[out->nsinks++] = sink;
+    return 1;
+}
+
+void outputs_send(const ecl_event_t *events, int count, int tick, void *ctx)
+{
+    outputs_t *out = (outputs_t *)ctx;
+    int i;
+
+    for (i = 0; out && i < out->nsinks; i++)
+    {
+        out->sinks[i]->send(out->sinks[i], tick, events, count);
+    }
+}
+
+/* OSC over UDP */
+
+#define OSC_MAX_DATAGRAM 65000
+#define OSC_NOTE_SIZE 40 /* address (12) + type tags (8) + five int32 args */
+
+typedef struct
+{
+    output_sink_t sink;
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    unsigned char buf[OSC_MAX_DATAGRAM];
+} udp_sink_t;
+
+static unsigned char *put_int32(unsigned char *p, int v)
+{
+    unsigned int u = (unsigned int)v;
+    p[0] = (unsigned char)(u >> 24);
+    p[1] = (unsigned char)(u >> 16);
+    p[2] = (unsigned char)(u >> 8);
+    p[3] = (unsigned char)u;
+    return p + 4;
+}
+
+static int udp_send(output_sink_t *sink, int tick, const ecl_event_t *events, int count)
+{
+    udp_sink_t *udp = (udp_sink_t *)sink;
+    unsigned char *p;
+    int i, ok = 1;
+
+    (void)tick;
+    while (count > 0)
+    {
+        /* "#bundle", then an immediate time tag */
+        p = udp->buf;
+        memcpy(p, "#bundle\0\0\0\0\0\0\0\0\1", 16);
+        p += 16;
+        for (i = 0; i < count && p + 4 + OSC_NOTE_SIZE <= udp->buf + OSC_MAX_DATAGRAM; i++)
+        {
+            p = put_int32(p, OSC_NOTE_SIZE);
+            memcpy(p, "/ecl/note\0\0\0,iiiii\0\0", 20);
+            p += 20;
+            p = put_int32(p, events[i].channel);
+            p = put_int32(p, events[i].note);
+            p = put_int32(p, events[i].octave);
+            p = put_int32(p, events[i].velocity);
+            p = put_int32(p, events[i].length);
+        }
+        if (sendto(udp->fd, udp->buf, p - udp->buf, 0,
+                   (struct sockaddr *)&udp->addr, udp->addrlen) < 0)
+        {
+            ok = 0;
+        }
+        events += i;
+        count -= i;
+    }
+    return ok;
+}
+
+static void udp_free(output_sink_t *sink)
+{
+    udp_sink_t *udp = (udp_sink_t *)sink;
+    close(udp->fd);
+    free(udp);
+}
+
+output_sink_t *output_udp_new(const char *host, int port)
+{
+    struct addrinfo hints, *res;
+    char service[16];
+    udp_sink_t *udp;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    sprintf(service, "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0)
+    {
+        printf("Error resolving %s\n", host);
+        return 0;
+    }
+    udp = calloc(1, sizeof(udp_sink_t));
+    if (!udp)
+    {
+        freeaddrinfo(res);
+        return 0;
+    }
+    udp->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (udp->fd < 0)
+    {
+        freeaddrinfo(res);
+        free(udp);
+        return 0;
+    }
+    memcpy(&udp->addr, res->ai_addr, res->ai_addrlen);
+    udp->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+    udp->sink.send = udp_send;
+    udp->sink.free = udp_free;
+    return &udp->sink;
+}
+
+/* Shared memory ring. The file starts with a header of four uint32 words:
+   magic, capacity (in events), head and tick, followed by capacity slots of
+   six int32 words: tick, channel, note, octave, velocity, length. head
+   counts every event ever written; event n lives in slot n % capacity.
+   Slots are written before head is published, so readers that see head
+   advance can read the slots up to it. */
+
+#define SHM_MAGIC 0x45434c31 /* "ECL1" */
+#define SHM_HEADER 4
+#define SHM_SLOT 6
+
+typedef struct
+{
+    output_sink_t sink;
+    unsigned int *map;
+    size_t size;
+} shm_sink_t;
+
+static int shm_send(output_sink_t *sink, int tick, const ecl_event_t *events, int count)
+{
+    shm_sink_t *shm = (shm_sink_t *)sink;
+    unsigned int head = shm->map[2], cap = shm->map[1];
+    int *slot, i;
+
+    for (i = 0; i < count; i++)
+    {
+        slot = (int *)&shm->map[SHM_HEADER + ((head + i) % cap) * SHM_SLOT];
+        slot[0] = tick;
+        slot[1] = events[i].channel;
+        slot[2] = events[i].note;
+        slot[3] = events[i].octave;
+        slot[4] = events[i].velocity;
+        slot[5] = events[i].length;
+    }
+    shm->map[3] = (unsigned int)tick;
+    __atomic_store_n(&shm->map[2], head + count, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void shm_free(output_sink_t *sink)
+{
+    shm_sink_t *shm = (shm_sink_t *)sink;
+    munmap(shm->map, shm->size);
+    free(shm);
+}
+
+output_sink_t *output_shm_new(const char *path, int capacity)
+{
+    shm_sink_t *shm;
+    size_t size;
+    void *map;
+    int fd;
+
+    if (capacity < 1)
+    {
+        return 0;
+    }
+    size = (SHM_HEADER + (size_t)capacity * SHM_SLOT) * sizeof(unsigned int);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        printf("Error opening %s\n", path);
+        return 0;
+    }
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    map = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return 0;
+    }
+    shm = calloc(1, sizeof(shm_sink_t));
+    if (!shm)
+    {
+        munmap(map, size);
+        return 0;
+    }
+    shm->map = map;
+    shm->size = size;
+    shm->map[0] = SHM_MAGIC;
+    shm->map[1] = (unsigned int)capacity;
+    shm->map[2] = 0;
+    shm->map[3] = 0;
+    shm->sink.send = shm_send;
+    shm->sink.free = shm_free;
+    return &shm->sink;
+}
+
+/* Text file */
+
+#define FILE_LINE_MAX 72 /* six ints and separators */
+
+typedef struct
+{
+    output_sink_t sink;
+    int fd;
+    char *buf;
+    int cap;
+} file_sink_t;
+
+static int file_send(output_sink_t *sink, int tick, const ecl_event_t *events, int count)
+{
+    file_sink_t *f = (file_sink_t *)sink;
+    const ecl_event_t *e;
+    char *buf;
+    int i, len = 0;
+
+    if (count * FILE_LINE_MAX > f->cap)
+    {
+        buf = realloc(f->buf, count * FILE_LINE_MAX);
+        if (!buf)
+        {
+            return 0;
+        }
+        f->buf = buf;
+        f->cap = count * FILE_LINE_MAX;
+    }
+    for (i = 0; i < count; i++)
+    {
+        e = &events[i];
+        len += sprintf(f->buf + len, "%d %d %d %d %d %d\n",
+                       tick, e->channel, e->note, e->octave, e->velocity, e->length);
+    }
+    return write(f->fd, f->buf, len) == len;
+}
+
+static void file_free(output_sink_t *sink)
+{
+    file_sink_t *f = (file_sink_t *)sink;
+    close(f->fd);
+    free(f->buf);
+    free(f);
+}
+
+output_sink_t *output_file_new(const char *path)
+{
+    file_sink_t *f;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        printf("Error opening %s\n", path);
+        return 0;
+    }
+    f = calloc(1, sizeof(file_sink_t));
+    if (!f)
+    {
+        close(fd);
+        return 0;
+    }
+    f->fd = fd;
+    f->sink.send = file_send;
+    f->sink.free = file_free;
+    return &f->sink;
+}
+
+output_sink_t *output_parse(const char *spec)
+{
+    char host[256];
+    const char *colon;
+    size_t len;
+
+    if (!strncmp(spec, "udp:", 4))
+    {
+        colon = strrchr(spec + 4, ':');
+        len = colon ? (size_t)(colon - (spec + 4)) : 0;
+        if (!colon || len >= sizeof(host))
+        {
+            return 0;
+        }
+        memcpy(host, spec + 4, len);
+        host[len] = 0;
+        return output_udp_new(host, atoi(colon + 1));
+    }
+    if (!strncmp(spec, "shm:", 4))
+    {
+        return output_shm_new(spec + 4, 4096);
+    }
+    if (!strncmp(spec, "file:", 5))
+    {
+        return output_file_new(spec + 5);
+    }
+    return 0;
+}
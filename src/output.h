@@ -0,0 +1,52 @@
+
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stdio.h>
+
+#include "ecl.h"
+
+#define OUTPUT_MAX_SINKS 8
+
+/* An output backend. Sinks receive all events of a tick at once and are
+   expected to deliver them with a single write. */
+typedef struct output_sink_t output_sink_t;
+struct output_sink_t
+{
+  /* Deliver the events of one tick; returns non-zero on success */
+  int (*send)(output_sink_t *sink, int tick, const ecl_event_t *events, int count);
+  /* Release the sink and anything it holds */
+  void (*free)(output_sink_t *sink);
+};
+
+/* A set of sinks that events of a tick are fanned out to */
+typedef struct outputs_t outputs_t;
+
+/* Create an empty output set; 0 when out of memory */
+outputs_t *outputs_new(void);
+
+/* Destroy an output set and every sink added to it */
+void outputs_free(outputs_t *out);
+
+/* Add a sink; the set takes ownership. Returns non-zero on success */
+int outputs_add(outputs_t *out, output_sink_t *sink);
+
+/* ECL batch output function (see ecl_set_output_batch); sends the events of
+   a tick to every sink in the set passed as ctx, which may be null */
+void outputs_send(const ecl_event_t *events, int count, int tick, void *ctx);
+
+/* OSC over UDP; each tick is sent as one bundle of /ecl/note messages with
+   int args channel, note, octave, velocity, length */
+output_sink_t *output_udp_new(const char *host, int port);
+
+/* Ring of events in a shared memory file (e.g. under /dev/shm) for
+   consumers on the same host; see output.c for the layout */
+output_sink_t *output_shm_new(const char *path, int capacity);
+
+/* Text file with one "tick channel note octave velocity length" line per event */
+output_sink_t *output_file_new(const char *path);
+
+/* Create a sink from "udp:host:port", "shm:path" or "file:path" */
+output_sink_t *output_parse(const char *spec);
+
+#endif
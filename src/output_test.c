@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "output.h"
+
+static int get_int32(const unsigned char *p)
+{
+  return (int)(((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+static int test_udp(outputs_t *out)
+{
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  unsigned char buf[1024];
+  ecl_event_t events[3] = {{0, 1, 2, 3, 4, 5}, {0, 6, 7, 8, 9, 10}, {0, 11, 12, 13, 14, 15}};
+  int fd, n, i;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      getsockname(fd, (struct sockaddr *)&addr, &len))
+  {
+    printf("udp: no loopback socket\n");
+    return 0;
+  }
+  outputs_add(out, output_udp_new("127.0.0.1", ntohs(addr.sin_port)));
+
+  outputs_send(events, 3, 7, out);
+
+  n = recv(fd, buf, sizeof(buf), 0);
+  close(fd);
+  if (n != 16 + 3 * 44 || memcmp(buf, "#bundle", 8))
+  {
+    printf("udp: unexpected bundle of %d bytes\n", n);
+    return 0;
+  }
+  for (i = 0; i < 3; i++)
+  {
+    const unsigned char *m = buf + 16 + i * 44;
+    if (get_int32(m) != 40 || strcmp((const char *)m + 4, "/ecl/note") ||
+        get_int32(m + 24) != i * 5 + 1 || get_int32(m + 40) != i * 5 + 5)
+    {
+      printf("udp: bad message %d\n", i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int test_file(const char *path)
+{
+  char line[128];
+  FILE *f = fopen(path, "r");
+  int ok = f && fgets(line, sizeof(line), f) && !strcmp(line, "7 1 2 3 4 5\n");
+
+  if (f)
+  {
+    fclose(f);
+  }
+  if (!ok)
+  {
+    printf("file: unexpected contents\n");
+  }
+  return ok;
+}
+
+static int test_shm(const char *path)
+{
+  unsigned int words[4 + 6];
+  FILE *f = fopen(path, "rb");
+  int ok = f && fread(words, sizeof(words), 1, f) == 1 &&
+           words[0] == 0x45434c31 && words[2] == 3 && words[3] == 7 &&
+           words[4] == 7 && words[5] == 1 && words[9] == 5;
+
+  if (f)
+  {
+    fclose(f);
+  }
+  if (!ok)
+  {
+    printf("shm: unexpected ring contents\n");
+  }
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  char file_path[] = "/tmp/ecl_output_test.txt";
+  char shm_path[] = "/tmp/ecl_output_test.shm";
+  outputs_t *out = outputs_new();
+  int ok;
+
+  (void)argc;
+  (void)argv;
+
+  outputs_add(out, output_file_new(file_path));
+  outputs_add(out, output_shm_new(shm_path, 16));
+  ok = test_udp(out);
+  outputs_free(out);
+  ok = test_file(file_path) && ok;
+  ok = test_shm(shm_path) && ok;
+  remove(file_path);
+  remove(shm_path);
+
+  printf("%s\n", ok ? "output ok" : "output FAILED");
+  return !ok;
+}
@@ -0,0 +1,118 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ecl.h"
+#include "pool.h"
+
+struct ecl_pool_t
+{
+    int x, y;
+    size_t size; /* bytes per block */
+    void **blocks; /* free blocks */
+    int nblocks, max_blocks;
+};
+
+/* Keep block for reuse; returns 0 when the free list cannot grow */
+static int keep(ecl_pool_t *pool, void *block)
+{
+    void **blocks;
+    int n;
+
+    if (pool->nblocks == pool->max_blocks)
+    {
+        n = pool->max_blocks ? pool->max_blocks * 2 : 16;
+        blocks = realloc(pool->blocks, n * sizeof(void *));
+        if (!blocks)
+        {
+            return 0;
+        }
+        pool->blocks = blocks;
+        pool->max_blocks = n;
+    }
+    pool->blocks[pool->nblocks++] = block;
+    return 1;
+}
+
+ecl_pool_t *ecl_pool_new(int x, int y, int count)
+{
+    ecl_pool_t *pool;
+    void *block;
+    int i;
+
+    if (!ecl_footprint(x, y))
+    {
+        return 0;
+    }
+    pool = calloc(1, sizeof(ecl_pool_t));
+    if (!pool)
+    {
+        return 0;
+    }
+    pool->x = x;
+    pool->y = y;
+    pool->size = ecl_footprint(x, y);
+    for (i = 0; i < count; i++)
+    {
+        if (posix_memalign(&block, ECL_ALIGN, pool->size))
+        {
+            break;
+        }
+        if (!keep(pool, block))
+        {
+            free(block);
+            break;
+        }
+    }
+    return pool;
+}
+
+void ecl_pool_free(ecl_pool_t *pool)
+{
+    int i;
+
+    if (pool)
+    {
+        for (i = 0; i < pool->nblocks; i++)
+        {
+            free(pool->blocks[i]);
+        }
+        free(pool->blocks);
+        free(pool);
+    }
+}
+
+ecl_t *ecl_pool_get(ecl_pool_t *pool, unsigned long seed)
+{
+    void *block;
+
+    if (!pool)
+    {
+        return 0;
+    }
+    if (pool->nblocks > 0)
+    {
+        block = pool->blocks[--pool->nblocks];
+    }
+    else if (posix_memalign(&block, ECL_ALIGN, pool->size))
+    {
+        return 0;
+    }
+    return ecl_new_in(block, pool->size, pool->x, pool->y, seed);
+}
+
+void ecl_pool_put(ecl_pool_t *pool, ecl_t *ecl)
+{
+    if (!pool || !ecl)
+    {
+        return;
+    }
+    /* releases whatever the instance allocated after creation; the
+       instance itself is the start of its block */
+    ecl_free(ecl);
+    if (!keep(pool, ecl))
+    {
+        free(ecl);
+    }
+}
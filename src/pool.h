@@ -0,0 +1,30 @@
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* A pool of ECL memories of one size. Instances returned to the pool keep
+   their block, which the next ecl_pool_get reuses, so creating and
+   destroying many instances (e.g. on scene changes) does not churn the
+   heap. Each instance is a single cache-line aligned block (see
+   ecl_new_in). */
+typedef struct ecl_pool_t ecl_pool_t;
+
+/* Create a pool of x by y memories with count blocks allocated up front */
+ecl_pool_t *ecl_pool_new(int x, int y, int count);
+
+/* Destroy a pool and the blocks it holds; instances still out are not
+   freed and must not be returned afterwards */
+void ecl_pool_free(ecl_pool_t *pool);
+
+/* Get an empty memory seeded with seed; returns null when out of memory */
+ecl_t *ecl_pool_get(ecl_pool_t *pool, unsigned long seed);
+
+/* Return a memory got from this pool */
+void ecl_pool_put(ecl_pool_t *pool, ecl_t *ecl);
+
+#endif
@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macro.h"
+#include "reference.h"
+#include "rng.h"
+
+#define WIDE(ecl) ((ecl)->wide != 0)
+
+/* Memory position of address x; negative addresses wrap by their size */
+static int at(ecl_t *ecl, int x)
+{
+    return (x >= 0 && x < ecl->memsz) ? x : abs(x) % ecl->memsz;
+}
+
+static char get(ecl_t *ecl, int x)
+{
+    return ecl->mem[at(ecl, x)];
+}
+
+static int get_state(ecl_t *ecl, int x)
+{
+    return ecl->state[at(ecl, x)];
+}
+
+static void set_state(ecl_t *ecl, int x, int s)
+{
+    ecl->state[at(ecl, x)] = s;
+}
+
+static int number(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z');
+}
+
+static int command(char c)
+{
+    return (c >= 'A' && c <= 'Z') || c == '<' || c == '>' || c == '$';
+}
+
+/* Value of a digit; 0 for anything else */
+static int digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a' + 10;
+    }
+    return 0;
+}
+
+/* Digit of v modulo 36, negative values by their size */
+static char glyph(int v)
+{
+    v %= 36;
+    if (v < 0)
+    {
+        v = -v;
+    }
+    return (char)(v <= 9 ? '0' + v : 'a' + (v - 10));
+}
+
+/* The number at x: its digit, or its value in wide memory */
+static int num(ecl_t *ecl, int x)
+{
+    return WIDE(ecl) ? ecl->wide[at(ecl, x)] : digit(get(ecl, x));
+}
+
+/* Write glyph c holding value v at x */
+static void put(ecl_t *ecl, int x, char c, int v)
+{
+    ecl_set(ecl, x, c);
+    if (WIDE(ecl))
+    {
+        ecl->wide[at(ecl, x)] = v;
+    }
+}
+
+/* Write the number v at x */
+static void put_num(ecl_t *ecl, int x, int v)
+{
+    put(ecl, x, glyph(v), v);
+}
+
+/* Copy the number at from to to */
+static void copy(ecl_t *ecl, int to, int from)
+{
+    put(ecl, to, get(ecl, from), WIDE(ecl) ? ecl->wide[at(ecl, from)] : 0);
+}
+
+/* A distance of at least one, reduced so it lands on the same cell */
+static int distance(ecl_t *ecl, int d)
+{
+    return d > ecl->memsz ? (d - 1) % ecl->memsz + 1 : d;
+}
+
+/* Arguments and bang inputs of command c; 0 if c is not implemented */
+static int shape(char c, int *args, int *bangs, int *pure)
+{
+    *args = 1;
+    *bangs = 1;
+    *pure = 0;
+    switch (c)
+    {
+    case 'A': case 'C': case 'D': case 'F': case 'I': case 'J': case 'M':
+    case 'P': case 'Q': case 'T': case 'Z': case '<': case '>': case '$':
+        return 1;
+    case 'S':
+        *args = -1; /* its first argument plus one */
+        return 1;
+    case 'E':
+        *args = 3;
+        return 1;
+    case 'O':
+        *args = 5;
+        return 1;
+    case 'R': case 'U': case 'V':
+        *args = 2;
+        return 1;
+    case 'X':
+        *args = 0;
+        return 1;
+    case 'G': case 'K':
+        *args = 2;
+        *bangs = 0;
+        *pure = 1;
+        return 1;
+    default:
+        *args = 0;
+        return 0;
+    }
+}
+
+static void add_event(ecl_t *ecl, int x, const int *vals)
+{
+    ecl_event_t *e;
+
+    if (ecl->nevents == ecl->max_events)
+    {
+        if (ecl->owns & ECL_OWNS_EVENTS)
+        {
+            e = realloc(ecl->events, ecl->max_events * 2 * sizeof(ecl_event_t));
+        }
+        else if ((e = malloc(ecl->max_events * 2 * sizeof(ecl_event_t))))
+        {
+            memcpy(e, ecl->events, ecl->max_events * sizeof(ecl_event_t));
+        }
+        if (!e)
+        {
+            return;
+        }
+        ecl->owns |= ECL_OWNS_EVENTS;
+        ecl->events = e;
+        ecl->max_events *= 2;
+    }
+    e = &ecl->events[ecl->nevents++];
+    e->x = x;
+    e->channel = vals[0];
+    e->note = vals[1];
+    e->octave = vals[2];
+    e->velocity = vals[3];
+    e->length = vals[4];
+}
+
+/* Run command c at x, which has banged */
+static void run(ecl_t *ecl, char c, int x)
+{
+    char bang = get(ecl, x - 1), arg = get(ecl, x + 1);
+    int v = num(ecl, x - 1), a, n, i, vals[5];
+    long long bucket;
+    ecl_t *in;
+
+    switch (c)
+    {
+    case 'A': /* accumulate into the argument */
+        a = num(ecl, x + 1);
+        n = WIDE(ecl) ? (int)(((unsigned int)a + (unsigned int)v) & ECL_WIDE_MAX) : (a + v) % 36;
+        if (v > 0)
+        {
+            put_num(ecl, x + 1, n);
+            set_state(ecl, x + 1, STATE_ARG);
+            put_num(ecl, x + 2, n);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'C': /* constant, or the bang with ? */
+        if (arg != '.')
+        {
+            copy(ecl, x + 2, arg == '?' ? x - 1 : x + 1);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'D': /* decrement, not below zero */
+    case 'I': /* increment, not above 35 or the wide limit */
+        a = (arg == '?') ? v : (arg == '.') ? 1 : num(ecl, x + 1);
+        if (c == 'D')
+        {
+            n = v > a ? v - a : 0;
+        }
+        else if (WIDE(ecl))
+        {
+            n = v > ECL_WIDE_MAX - a ? ECL_WIDE_MAX : v + a;
+        }
+        else
+        {
+            n = v + a > 35 ? 35 : v + a;
+        }
+        put_num(ecl, x + 2, n);
+        set_state(ecl, x + 2, STATE_NUM);
+        break;
+    case 'E': /* euclidean rhythm: pulses, steps, current step */
+    {
+        int pulses, steps, cur;
+
+        if (v <= 0)
+        {
+            break;
+        }
+        steps = get(ecl, x + 2) != '.' ? num(ecl, x + 2) : 3;
+        steps = steps < 1 ? 3 : steps;
+        pulses = get(ecl, x + 1) != '.' ? num(ecl, x + 1) : 1;
+        pulses = pulses < 1 ? 1 : pulses > steps ? steps : pulses;
+        if (get(ecl, x + 3) == '.')
+        {
+            cur = 1;
+        }
+        else
+        {
+            cur = num(ecl, x + 3);
+            cur += cur < ECL_WIDE_MAX;
+        }
+        bucket = (long long)pulses * ((long long)cur + steps - 1) % steps + pulses;
+        if (bucket >= steps)
+        {
+            put_num(ecl, x + 4, cur);
+            set_state(ecl, x + 4, STATE_NUM);
+            cur = (cur == steps) ? 0 : cur;
+        }
+        put_num(ecl, x + 3, cur);
+        set_state(ecl, x + 3, STATE_NUM);
+        break;
+    }
+    case 'F': /* pass the bang if it matches */
+        if ((WIDE(ecl) && number(arg) && number(bang)) ? num(ecl, x + 1) == v : arg == bang)
+        {
+            put(ecl, x + 2, bang, v);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'G': /* clock: rate, modulo */
+    {
+        int rate, mod;
+
+        if (bang == '.' || v > 0)
+        {
+            rate = num(ecl, get(ecl, x + 1) == '?' ? x - 1 : x + 1);
+            rate = rate < 1 ? 8 : rate;
+            if (ecl->now % rate == 0)
+            {
+                mod = num(ecl, get(ecl, x + 2) == '?' ? x - 1 : x + 2);
+                mod = mod < 1 ? 1 : mod;
+                put_num(ecl, x + 3, ((ecl->now + 1) / rate) % mod + 1);
+                set_state(ecl, x + 3, STATE_NUM);
+            }
+        }
+        if (get_state(ecl, x - 1) == STATE_NUM && get_state(ecl, x - 2) == STATE_NUM)
+        {
+            ecl_set(ecl, x - 1, '.');
+            set_state(ecl, x - 1, STATE_EMPTY);
+        }
+        break;
+    }
+    case 'J': /* jump the bang over cells */
+        if (arg == '?')
+        {
+            n = x + distance(ecl, v) + 1;
+        }
+        else if (arg == '.')
+        {
+            n = x + 2;
+        }
+        else
+        {
+            a = num(ecl, x + 1);
+            n = x + distance(ecl, a < 1 ? 1 : a) + 1;
+        }
+        put(ecl, n, bang, v);
+        set_state(ecl, n, STATE_NUM);
+        break;
+    case 'K': /* macro instance, run by this evaluator too */
+        in = macro_enter(ecl, x, digit(arg));
+        if (in)
+        {
+            if (get_state(ecl, x - 1) == STATE_NUM)
+            {
+                put(in, 0, bang, v);
+            }
+            in->vars[0] = get(ecl, x + 2);
+            in->var_values[0] = num(ecl, x + 2);
+            if (in->state[in->memsz - 1] == STATE_NUM)
+            {
+                put(ecl, x + 3, get(in, in->memsz - 1), num(in, in->memsz - 1));
+                set_state(ecl, x + 3, STATE_NUM);
+            }
+            in->clock = ecl->now;
+            reference_eval(in);
+            for (i = 0; i < in->nevents; i++)
+            {
+                vals[0] = in->events[i].channel;
+                vals[1] = in->events[i].note;
+                vals[2] = in->events[i].octave;
+                vals[3] = in->events[i].velocity;
+                vals[4] = in->events[i].length;
+                add_event(ecl, x, vals);
+            }
+        }
+        if (get_state(ecl, x - 1) == STATE_NUM)
+        {
+            ecl_set(ecl, x - 1, '.');
+            set_state(ecl, x - 1, STATE_EMPTY);
+        }
+        break;
+    case 'M': /* bang modulo argument; modulo zero is zero */
+        if (arg != '.')
+        {
+            a = num(ecl, x + 1);
+            put_num(ecl, x + 2, a ? v % a : 0);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'O': /* note: channel, note, octave, velocity, length */
+        for (i = 0; i < 5; i++)
+        {
+            vals[i] = num(ecl, get(ecl, x + i + 1) == '?' ? x - 1 : x + i + 1);
+        }
+        vals[0] = vals[0] > 15 ? 0 : vals[0];
+        add_event(ecl, x, vals);
+        break;
+    case 'P': /* pass the bang with probability arg / 36 */
+        a = num(ecl, arg == '?' ? x - 1 : x + 1);
+        if (a > 0 && (a >= 35 || rng_double(ecl->rng) < (double)a / 36.0))
+        {
+            put(ecl, x + 2, bang, v);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'Q': /* read a variable */
+        if (arg != '.' && ecl->vars[digit(arg)] != '.')
+        {
+            put(ecl, x + 2, ecl->vars[digit(arg)], ecl->var_values[digit(arg)]);
+            set_state(ecl, x + 2, STATE_NUM);
+        }
+        break;
+    case 'R': /* random in [min, max] */
+    {
+        int min, max;
+
+        min = num(ecl, arg == '?' ? x - 1 : x + 1);
+        max = num(ecl, get(ecl, x + 2) == '?' ? x - 1 : x + 2);
+        max += max < ECL_WIDE_MAX;
+        if (max <= min)
+        {
+            max = (min < ECL_WIDE_MAX - 1) ? min + 2 : ECL_WIDE_MAX;
+        }
+        put_num(ecl, x + 3, (int)(rng_double(ecl->rng) * (max - min) + min));
+        set_state(ecl, x + 3, STATE_NUM);
+        break;
+    }
+    case 'S': /* sequence: length, then the steps */
+        n = digit(arg);
+        if (n > 0 && v > 0)
+        {
+            a = x + 2 + (v - 1) % n;
+            if (get(ecl, a) != '.')
+            {
+                copy(ecl, x + 2 + n, a);
+                set_state(ecl, x + 2 + n, STATE_NUM);
+            }
+        }
+        break;
+    case 'T': /* send on a channel */
+        ecl->channels[arg == '?' ? 0 : digit(arg)] = v;
+        break;
+    case 'U': /* send on a two digit channel */
+        ecl->channels[digit(arg) * 36 + digit(get(ecl, x + 2))] = v;
+        break;
+    case 'V': /* store a variable */
+        if (arg != '.')
+        {
+            ecl->vars[digit(arg)] = bang;
+            ecl->var_values[digit(arg)] = v;
+            put(ecl, x + 2, bang, v);
+            set_state(ecl, x + 2, STATE_ARG);
+            put(ecl, x + 3, bang, v);
+            set_state(ecl, x + 3, STATE_NUM);
+        }
+        break;
+    case '<': /* move the bang columns left */
+    case '>': /* or right, not past the edges */
+        if (v > 0)
+        {
+            a = (arg == '?') ? v : (arg == '.') ? 1 : num(ecl, x + 1);
+            a = (a == 0) ? 2 : ecl->height * (a < ecl->width ? a : ecl->width);
+            if (c == '>' && x + a < ecl->memsz)
+            {
+                put(ecl, x + a, bang, v);
+                set_state(ecl, x + a, STATE_NUM);
+            }
+            else if (c == '<' && x - a > 0)
+            {
+                put(ecl, x - a, bang, v);
+                set_state(ecl, x - a, STATE_NEW);
+            }
+        }
+        break;
+    case '$': /* the bang below, and again further on */
+        if (v > 0)
+        {
+            a = (arg == '?') ? v : (arg == '.') ? 1 : num(ecl, x + 1);
+            put(ecl, x + 2, bang, v);
+            set_state(ecl, x + 2, STATE_NUM);
+            n = x + 2 + (a < 1 ? 1 : distance(ecl, a));
+            put(ecl, n, bang, v);
+            set_state(ecl, n, STATE_NUM);
+        }
+        break;
+    default: /* X does nothing but eat its bang; neither does Z yet */
+        break;
+    }
+}
+
+/* State of every cell as the tick starts, arguments counted out of memory */
+static void classify(ecl_t *ecl)
+{
+    int x, s, args, bangs, pure, n = 0;
+    char v;
+
+    if (ecl->macros)
+    { /* instances of removed K cells go, as on a recompile */
+        macro_prune(ecl);
+    }
+    for (x = 0; x < ecl->memsz; x++)
+    {
+        v = ecl->mem[x];
+        if (n > 0)
+        {
+            s = STATE_ARG;
+            n--;
+        }
+        else if (v == '.')
+        {
+            s = STATE_EMPTY;
+        }
+        else if (number(v))
+        {
+            s = STATE_NUM;
+        }
+        else if (command(v))
+        {
+            s = STATE_CMD;
+            shape(v, &args, &bangs, &pure);
+            n = args < 0 ? (get(ecl, x + 1) == '.' ? 1 : digit(get(ecl, x + 1)) + 1) : args;
+        }
+        else
+        {
+            s = STATE_ERR;
+        }
+        ecl->state[x] = s;
+    }
+}
+
+/* One tick of the cells from lo up to hi */
+static void pass(ecl_t *ecl, int lo, int hi)
+{
+    int x, y, args, bangs, pure;
+
+    for (x = hi - 1; x >= lo; x--)
+    {
+        if (ecl->state[x] == STATE_NUM)
+        {
+            if ((x + 1) % ecl->height == 0)
+            { /* off the bottom */
+                ecl_set(ecl, x, '.');
+                ecl->state[x] = STATE_EMPTY;
+            }
+            else if (ecl->state[x + 1] == STATE_EMPTY)
+            { /* down a cell */
+                copy(ecl, x + 1, x);
+                ecl->state[x + 1] = STATE_NUM;
+                ecl_set(ecl, x, '.');
+                ecl->state[x] = STATE_EMPTY;
+            }
+        }
+        else if (ecl->state[x] == STATE_CMD && shape(ecl->mem[x], &args, &bangs, &pure))
+        {
+            for (y = 1; y <= bangs && get_state(ecl, x - y) == STATE_NUM; y++)
+            {
+            }
+            if (y > bangs || pure)
+            {
+                run(ecl, ecl->mem[x], x);
+                for (y = 1; y <= bangs; y++)
+                {
+                    ecl_set(ecl, x - y, '.');
+                    set_state(ecl, x - y, STATE_EMPTY);
+                }
+            }
+        }
+    }
+}
+
+/* Clock of column col; -1 for the main clock */
+static int clock_of(ecl_t *ecl, int col)
+{
+    int i;
+
+    for (i = 0; i < ECL_CLOCKS; i++)
+    {
+        if (ecl->clocks[i].cols > 0 && col >= ecl->clocks[i].col &&
+            col < ecl->clocks[i].col + ecl->clocks[i].cols)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Deliver written channels to every T and U, in address order */
+static void teleport(ecl_t *ecl)
+{
+    int x, c, to;
+
+    for (x = 0; x < ecl->memsz; x++)
+    {
+        if (ecl->mem[x] == 'T')
+        {
+            c = digit(get(ecl, x + 1));
+            to = (x + 2) % ecl->memsz;
+        }
+        else if (ecl->mem[x] == 'U')
+        {
+            c = digit(get(ecl, x + 1)) * 36 + digit(get(ecl, x + 2));
+            to = (x + 3) % ecl->memsz;
+        }
+        else
+        {
+            continue;
+        }
+        if (ecl->channels[c] > 0)
+        {
+            put_num(ecl, to, ecl->channels[c]);
+            ecl->state[to] = STATE_NUM;
+        }
+    }
+    memset(ecl->channels, 0, sizeof(ecl->channels));
+    memset(ecl->marks, 0, sizeof(ecl->marks));
+    ecl->nsent = 0;
+}
+
+void reference_eval(ecl_t *ecl)
+{
+    long long t = ecl->clock, tick, due;
+    int hi, lo, id, i;
+    ecl_clock_t *c;
+
+    ecl->nevents = 0;
+    classify(ecl);
+    /* runs of columns on one clock, from the last; each goes once for
+       every tick its clock makes during this one */
+    for (hi = ecl->width; hi > 0; hi = lo)
+    {
+        id = clock_of(ecl, hi - 1);
+        for (lo = hi - 1; lo > 0 && clock_of(ecl, lo - 1) == id; lo--)
+        {
+        }
+        if (id < 0)
+        {
+            ecl->now = ecl->clock;
+            pass(ecl, lo * ecl->height, hi * ecl->height);
+            continue;
+        }
+        c = &ecl->clocks[id];
+        for (tick = t * c->mul / c->div, due = (t + 1) * c->mul / c->div; tick < due; tick++)
+        {
+            ecl->now = (int)tick;
+            pass(ecl, lo * ecl->height, hi * ecl->height);
+        }
+    }
+    ecl->now = ecl->clock;
+    teleport(ecl);
+    if (ecl->nevents > 0 && ecl->batch_fn)
+    {
+        ecl->batch_fn(ecl->events, ecl->nevents, ecl->clock, ecl->batch_ctx);
+    }
+    for (i = 0; i < ecl->nevents && ecl->output_fn; i++)
+    {
+        ecl->output_fn(ecl->events[i].channel, ecl->events[i].note, ecl->events[i].octave,
+                       ecl->events[i].velocity, ecl->events[i].length, ecl->output_ctx);
+    }
+    ecl->clock++;
+}
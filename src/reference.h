@@ -0,0 +1,18 @@
+
+#ifndef _REFERENCE_H_
+#define _REFERENCE_H_
+
+#include "ecl.h"
+
+/* The evaluator as it was before layouts were compiled, kept apart from
+   ecl.c so that it shares none of the engine's code: arguments are counted
+   out of memory on every tick, commands go through a switch of their own,
+   teleports are found by a scan. Slow, but simple enough to trust; ecl_eval
+   must match it tick for tick (see diff_test.c). Commands and features
+   added to the engine are added here too, written out again. Only built
+   into the tests and the fuzzer. Visual heat and counters are left alone. */
+
+/* Evaluate a memory once */
+void reference_eval(ecl_t *ecl);
+
+#endif
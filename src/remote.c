@@ -0,0 +1,654 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ecl.h"
+#include "mirror.h"
+#include "remote.h"
+
+#define INBOX_SIZE (1 << 20)
+#define OUTBOX_SIZE (1 << 22)
+#define FRAME_HEADER 5 /* type, u32 length */
+
+/* Single producer, single consumer byte ring of length-prefixed records.
+   head and tail count every byte ever written and read; each side only
+   stores its own counter, after the bytes it covers. */
+typedef struct
+{
+    unsigned char *buf;
+    size_t size; /* power of two */
+    size_t head, tail;
+} ring_t;
+
+typedef struct
+{
+    int fd;         /* -1 when the slot is free */
+    int closing;    /* disconnected, but the interpreter has not been told yet */
+    int stalled;    /* a complete frame is waiting for room in the inbox */
+    unsigned char *buf; /* bytes received but not yet queued */
+    size_t len;
+} client_t;
+
+struct remote_t
+{
+    int listen_fd, wake[2], stop;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    pthread_t thread;
+    ring_t inbox, outbox;
+
+    /* network thread */
+    client_t clients[REMOTE_MAX_CLIENTS];
+    unsigned char *out;
+    size_t out_cap;
+
+    /* interpreter thread */
+    unsigned char *msg, *frame;
+    size_t msg_cap, frame_cap;
+    unsigned int subscribers, resync; /* one bit per client */
+    mirror_t *mirror;
+    int prev_clock, pushed;
+};
+
+static void put_u16(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int get_u16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/* Make room for n bytes in a growable buffer; returns 0 when out of memory */
+static int reserve(unsigned char **buf, size_t *cap, size_t n)
+{
+    unsigned char *p;
+    size_t c = *cap ? *cap : 4096;
+
+    if (n <= *cap)
+    {
+        return 1;
+    }
+    while (c < n)
+    {
+        c *= 2;
+    }
+    p = realloc(*buf, c);
+    if (!p)
+    {
+        return 0;
+    }
+    *buf = p;
+    *cap = c;
+    return 1;
+}
+
+static int ring_init(ring_t *q, size_t size)
+{
+    q->buf = malloc(size);
+    q->size = size;
+    q->head = q->tail = 0;
+    return q->buf != 0;
+}
+
+static void ring_write(ring_t *q, size_t at, const void *src, size_t n)
+{
+    size_t i = at & (q->size - 1), first = q->size - i < n ? q->size - i : n;
+
+    memcpy(q->buf + i, src, first);
+    memcpy(q->buf, (const unsigned char *)src + first, n - first);
+}
+
+static void ring_read(ring_t *q, size_t at, void *dst, size_t n)
+{
+    size_t i = at & (q->size - 1), first = q->size - i < n ? q->size - i : n;
+
+    memcpy(dst, q->buf + i, first);
+    memcpy((unsigned char *)dst + first, q->buf, n - first);
+}
+
+/* Append the record a + b; returns 0 when it does not fit */
+static int ring_push(ring_t *q, const void *a, size_t na, const void *b, size_t nb)
+{
+    size_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    unsigned char len[4];
+
+    if (q->size - (q->head - tail) < sizeof(len) + na + nb)
+    {
+        return 0;
+    }
+    put_u32(len, (unsigned int)(na + nb));
+    ring_write(q, q->head, len, sizeof(len));
+    ring_write(q, q->head + sizeof(len), a, na);
+    ring_write(q, q->head + sizeof(len) + na, b, nb);
+    __atomic_store_n(&q->head, q->head + sizeof(len) + na + nb, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Take the next record into a growable buffer; returns its length, or -1
+   when the ring is empty */
+static long ring_pop(ring_t *q, unsigned char **buf, size_t *cap)
+{
+    size_t head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    unsigned char len[4];
+    unsigned int n;
+
+    if (q->tail == head)
+    {
+        return -1;
+    }
+    ring_read(q, q->tail, len, sizeof(len));
+    n = get_u32(len);
+    if (!reserve(buf, cap, n))
+    {
+        return -1;
+    }
+    ring_read(q, q->tail + sizeof(len), *buf, n);
+    __atomic_store_n(&q->tail, q->tail + sizeof(len) + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* Network thread */
+
+static void client_close(client_t *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->closing = 1;
+    c->len = 0;
+}
+
+/* Queue the complete frames received from client i */
+static void client_parse(remote_t *r, int i)
+{
+    client_t *c = &r->clients[i];
+    unsigned char id[2];
+    size_t at = 0, n;
+
+    c->stalled = 0;
+    while (c->len - at >= FRAME_HEADER)
+    {
+        n = get_u32(c->buf + at + 1);
+        if (n > REMOTE_MAX_FRAME)
+        {
+            client_close(c);
+            return;
+        }
+        if (c->len - at < FRAME_HEADER + n)
+        {
+            break;
+        }
+        id[0] = (unsigned char)i;
+        id[1] = c->buf[at];
+        if (!ring_push(&r->inbox, id, 2, c->buf + at + FRAME_HEADER, n))
+        {
+            c->stalled = 1;
+            break;
+        }
+        at += FRAME_HEADER + n;
+    }
+    memmove(c->buf, c->buf + at, c->len - at);
+    c->len -= at;
+}
+
+static void client_accept(remote_t *r)
+{
+    int fd = accept(r->listen_fd, 0, 0), one = 1, i;
+
+    if (fd < 0)
+    {
+        return;
+    }
+    for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+    {
+        client_t *c = &r->clients[i];
+        if (c->fd < 0 && !c->closing)
+        {
+            if (!c->buf)
+            {
+                c->buf = malloc(FRAME_HEADER + REMOTE_MAX_FRAME);
+            }
+            if (!c->buf)
+            {
+                break;
+            }
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            c->fd = fd;
+            c->len = 0;
+            c->stalled = 0;
+            return;
+        }
+    }
+    close(fd);
+}
+
+static int send_all(int fd, const unsigned char *p, size_t n)
+{
+    ssize_t k;
+
+    while (n > 0)
+    {
+        k = send(fd, p, n, MSG_NOSIGNAL);
+        if (k <= 0)
+        {
+            return 0;
+        }
+        p += k;
+        n -= k;
+    }
+    return 1;
+}
+
+/* Send everything the interpreter queued; records are a u32 client mask
+   followed by a complete frame */
+static void drain_outbox(remote_t *r)
+{
+    long n;
+    unsigned int mask;
+    int i;
+
+    while ((n = ring_pop(&r->outbox, &r->out, &r->out_cap)) >= 4)
+    {
+        mask = get_u32(r->out);
+        for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+        {
+            if ((mask & (1u << i)) && r->clients[i].fd >= 0 &&
+                !send_all(r->clients[i].fd, r->out + 4, n - 4))
+            {
+                client_close(&r->clients[i]);
+            }
+        }
+    }
+}
+
+static void *serve(void *arg)
+{
+    remote_t *r = (remote_t *)arg;
+    struct pollfd fds[2 + REMOTE_MAX_CLIENTS];
+    int slot[REMOTE_MAX_CLIENTS];
+    unsigned char bye[2] = {0, 'S'}, junk[64];
+    int i, n, pending;
+    ssize_t k;
+    client_t *c;
+
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE))
+    {
+        pending = 0;
+        for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+        {
+            c = &r->clients[i];
+            if (c->fd >= 0 && (c->stalled || c->len >= FRAME_HEADER))
+            {
+                client_parse(r, i);
+            }
+            if (c->closing)
+            { /* an 'S' with no payload ends any subscription of the slot */
+                bye[0] = (unsigned char)i;
+                c->closing = !ring_push(&r->inbox, bye, 2, 0, 0);
+            }
+            pending |= c->stalled || c->closing;
+        }
+
+        fds[0].fd = r->listen_fd;
+        fds[1].fd = r->wake[0];
+        fds[0].events = fds[1].events = POLLIN;
+        n = 2;
+        for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+        {
+            if (r->clients[i].fd >= 0)
+            {
+                fds[n].fd = r->clients[i].fd;
+                fds[n].events = r->clients[i].stalled ? 0 : POLLIN;
+                slot[n - 2] = i;
+                n++;
+            }
+        }
+        if (poll(fds, n, pending ? 1 : 1000) < 0)
+        {
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            client_accept(r);
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            while (read(r->wake[0], junk, sizeof(junk)) > 0)
+            {
+            }
+        }
+        for (i = 2; i < n; i++)
+        {
+            c = &r->clients[slot[i - 2]];
+            if (!fds[i].revents || c->fd < 0)
+            {
+                continue;
+            }
+            k = recv(c->fd, c->buf + c->len, FRAME_HEADER + REMOTE_MAX_FRAME - c->len, 0);
+            if (k <= 0)
+            {
+                client_close(c);
+                continue;
+            }
+            c->len += k;
+            client_parse(r, slot[i - 2]);
+        }
+        drain_outbox(r);
+    }
+    return 0;
+}
+
+/* Interpreter thread */
+
+static void send_frame(remote_t *r, unsigned int mask, int type,
+                       const unsigned char *payload, size_t n, unsigned int *failed)
+{
+    unsigned char head[4 + FRAME_HEADER];
+
+    put_u32(head, mask);
+    head[4] = (unsigned char)type;
+    put_u32(head + 5, (unsigned int)n);
+    if (ring_push(&r->outbox, head, sizeof(head), payload, n))
+    {
+        r->pushed = 1;
+    }
+    else if (failed)
+    {
+        *failed |= mask;
+    }
+}
+
+/* Answer an 'R' or 'V' request with the values or the activity of a region */
+static void read_region(remote_t *r, ecl_t *ecl, int client, int type, const unsigned char *p)
+{
+    unsigned int x = get_u16(p), y = get_u16(p + 2), w = get_u16(p + 4), h = get_u16(p + 6);
+    unsigned int width = ecl->width, height = ecl->height, i, j;
+    unsigned char *out;
+
+    if (x >= width || y >= height)
+    {
+        w = h = 0;
+    }
+    w = w < width - x ? w : width - x;
+    h = h < height - y ? h : height - y;
+    if (!reserve(&r->frame, &r->frame_cap, 8 + (size_t)w * h))
+    {
+        return;
+    }
+    put_u16(r->frame, x);
+    put_u16(r->frame + 2, y);
+    put_u16(r->frame + 4, w);
+    put_u16(r->frame + 6, h);
+    out = r->frame + 8;
+    for (i = 0; i < w; i++, out += h)
+    {
+        if (type == 'R')
+        { /* columns are contiguous in memory */
+            memcpy(out, ecl->mem + (x + i) * height + y, h);
+            continue;
+        }
+        for (j = 0; j < h; j++)
+        {
+            out[j] = (unsigned char)ecl_get_visual(ecl, (x + i) * height + y + j);
+        }
+    }
+    send_frame(r, 1u << client, type == 'R' ? 'r' : 'v', r->frame, 8 + (size_t)w * h, 0);
+}
+
+/* Returns non-zero when the request wrote cells */
+static int handle(remote_t *r, ecl_t *ecl, int client, int type,
+                   const unsigned char *p, size_t n)
+{
+    unsigned int addr, bit = 1u << client;
+    size_t i;
+
+    switch (type)
+    {
+    case 'W':
+        for (i = 0; i + 5 <= n; i += 5)
+        {
+            addr = get_u32(p + i);
+            if (addr < (unsigned int)ecl->memsz)
+            {
+                ecl_set(ecl, addr, (char)p[i + 4]);
+            }
+        }
+        return n >= 5;
+    case 'R':
+    case 'V':
+        if (n >= 8)
+        {
+            read_region(r, ecl, client, type, p);
+        }
+        break;
+    case 'S':
+        if (n && p[0])
+        {
+            r->subscribers |= bit;
+            r->resync |= bit;
+        }
+        else
+        {
+            r->subscribers &= ~bit;
+            r->resync &= ~bit;
+        }
+        break;
+    }
+    return 0;
+}
+
+/* Send the tick as a delta to synced subscribers and as a keyframe to new
+   ones */
+static void publish(remote_t *r, ecl_t *ecl)
+{
+    unsigned int synced, failed = 0;
+    const unsigned char *msg;
+    size_t n;
+
+    if (!r->subscribers || (!r->mirror && !(r->mirror = mirror_new())))
+    {
+        return;
+    }
+    synced = r->subscribers & ~r->resync;
+    if (synced)
+    {
+        n = mirror_encode(r->mirror, ecl, 0, &msg);
+        if (n && msg[0] == 'K')
+        { /* the memory was resized; everyone starts over */
+            r->resync = r->subscribers;
+        }
+        else if (n > 5 || ecl->clock != r->prev_clock)
+        {
+            send_frame(r, synced, 'm', msg, n, &failed);
+        }
+    }
+    if (r->resync)
+    {
+        n = mirror_encode(r->mirror, ecl, 1, &msg);
+        if (n)
+        {
+            send_frame(r, r->resync, 'm', msg, n, &failed);
+            r->resync = 0;
+        }
+    }
+    /* a subscriber that missed a message starts over from a keyframe */
+    r->resync |= failed;
+    r->prev_clock = ecl->clock;
+}
+
+int remote_tick(remote_t *r, ecl_t *ecl)
+{
+    int written = 0;
+    long n;
+
+    if (!r || !ecl)
+    {
+        return 0;
+    }
+    r->pushed = 0;
+    while ((n = ring_pop(&r->inbox, &r->msg, &r->msg_cap)) >= 2)
+    {
+        if (r->msg[0] < REMOTE_MAX_CLIENTS)
+        {
+            written |= handle(r, ecl, r->msg[0], r->msg[1], r->msg + 2, n - 2);
+        }
+    }
+    publish(r, ecl);
+    if (r->pushed && write(r->wake[1], "", 1) < 0)
+    {
+        /* pipe full: the network thread is already awake */
+    }
+    return written;
+}
+
+/* Setup */
+
+static int listen_tcp(int port)
+{
+    struct sockaddr_in addr;
+    int fd = socket(AF_INET, SOCK_STREAM, 0), one = 1;
+
+    if (fd < 0)
+    {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 4))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_unix(remote_t *r, const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 4))
+    {
+        close(fd);
+        return -1;
+    }
+    strcpy(r->path, path);
+    return fd;
+}
+
+remote_t *remote_new(const char *addr)
+{
+    remote_t *r = calloc(1, sizeof(remote_t));
+    int i;
+
+    if (!r)
+    {
+        return 0;
+    }
+    for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+    {
+        r->clients[i].fd = -1;
+    }
+    r->wake[0] = r->wake[1] = -1;
+    r->listen_fd = strncmp(addr, "tcp:", 4) ? listen_unix(r, addr) : listen_tcp(atoi(addr + 4));
+    if (r->listen_fd < 0 || pipe(r->wake) ||
+        fcntl(r->wake[0], F_SETFL, O_NONBLOCK) || fcntl(r->wake[1], F_SETFL, O_NONBLOCK) ||
+        !ring_init(&r->inbox, INBOX_SIZE) || !ring_init(&r->outbox, OUTBOX_SIZE) ||
+        pthread_create(&r->thread, 0, serve, r))
+    {
+        printf("Error listening on %s\n", addr);
+        r->stop = 1;
+        remote_free(r);
+        return 0;
+    }
+    return r;
+}
+
+void remote_free(remote_t *r)
+{
+    int i;
+
+    if (!r)
+    {
+        return;
+    }
+    if (!r->stop)
+    {
+        __atomic_store_n(&r->stop, 1, __ATOMIC_RELEASE);
+        if (write(r->wake[1], "", 1) < 0)
+        {
+            /* the thread polls with a timeout anyway */
+        }
+        pthread_join(r->thread, 0);
+    }
+    for (i = 0; i < REMOTE_MAX_CLIENTS; i++)
+    {
+        if (r->clients[i].fd >= 0)
+        {
+            close(r->clients[i].fd);
+        }
+        free(r->clients[i].buf);
+    }
+    if (r->listen_fd >= 0)
+    {
+        close(r->listen_fd);
+    }
+    if (r->path[0])
+    {
+        unlink(r->path);
+    }
+    if (r->wake[0] >= 0)
+    {
+        close(r->wake[0]);
+        close(r->wake[1]);
+    }
+    free(r->inbox.buf);
+    free(r->outbox.buf);
+    free(r->out);
+    free(r->msg);
+    free(r->frame);
+    mirror_free(r->mirror);
+    free(r);
+}
@@ -0,0 +1,42 @@
+
+#ifndef _REMOTE_H_
+#define _REMOTE_H_
+
+#include <stdio.h>
+
+#include "ecl.h"
+
+#define REMOTE_MAX_CLIENTS 16
+#define REMOTE_MAX_FRAME 65536 /* largest payload accepted from a client */
+
+/* Remote control of an ECL memory over a local socket. A network thread
+   owns the sockets and passes requests to the interpreter through a
+   lock-free inbox; the interpreter applies them at tick boundaries in
+   remote_tick and never blocks on a client.
+
+   Every frame is a type byte, a little-endian u32 payload length and the
+   payload; all integers are little-endian.
+   Client to server:
+     'W' write cells:   repeated (u32 address, u8 value)
+     'R' read region:   u16 x, u16 y, u16 w, u16 h
+     'V' read activity: as 'R', answered with 'v'
+     'S' subscribe:     u8 on; while on, every tick sends an 'm' frame
+   Server to client:
+     'r' region:        u16 x, u16 y, u16 w, u16 h, then w * h values by column
+     'v' activity:      as 'r', with ecl_get_visual of each cell
+     'm' mirror:        a mirror message (see mirror.h); a subscription starts
+                        with a keyframe, then gets a delta for every tick */
+typedef struct remote_t remote_t;
+
+/* Listen on a Unix socket path, or on localhost with "tcp:port" */
+remote_t *remote_new(const char *addr);
+
+/* Stop the network thread and close every connection */
+void remote_free(remote_t *r);
+
+/* Apply queued requests to ecl and publish the tick to subscribers. Call
+   from the thread running ecl_eval, between ticks. Returns non-zero when
+   cells were written. */
+int remote_tick(remote_t *r, ecl_t *ecl);
+
+#endif
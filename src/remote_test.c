@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ecl.h"
+#include "mirror.h"
+#include "remote.h"
+
+static const char *path = "/tmp/ecl_remote_test.sock";
+
+static void pause_ms(int ms)
+{
+  struct timespec ts = {0, ms * 1000000L};
+  nanosleep(&ts, 0);
+}
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int connect_to(void)
+{
+  struct sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+  {
+    return -1;
+  }
+  return fd;
+}
+
+static int send_frame(int fd, int type, const unsigned char *payload, unsigned int n)
+{
+  unsigned char head[5];
+
+  head[0] = (unsigned char)type;
+  put_u32(head + 1, n);
+  return write(fd, head, 5) == 5 && write(fd, payload, n) == (ssize_t)n;
+}
+
+/* Read one frame, ticking the interpreter while waiting for it */
+static int recv_frame(int fd, remote_t *r, ecl_t *ecl, unsigned char *buf, int max)
+{
+  int len = 0, need = 5, tries, k;
+
+  for (tries = 0; tries < 1000 && len < need; tries++)
+  {
+    remote_tick(r, ecl);
+    k = recv(fd, buf + len, need - len, MSG_DONTWAIT);
+    if (k > 0)
+    {
+      len += k;
+      if (len == 5)
+      {
+        need = 5 + (int)get_u32(buf + 1);
+        if (need > max)
+        {
+          return -1;
+        }
+      }
+    }
+    else
+    {
+      pause_ms(1);
+    }
+  }
+  return len == need ? buf[0] : -1;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned char buf[4096], req[16];
+  ecl_t *ecl = ecl_new(8, 4, (unsigned long)42);
+  ecl_t *copy = ecl_new(8, 4, (unsigned long)42);
+  mirror_t *m = mirror_new();
+  remote_t *r = remote_new(path);
+  int fd, ok = 1, type, i;
+
+  (void)argc;
+  (void)argv;
+
+  if (!r || (fd = connect_to()) < 0)
+  {
+    printf("remote: cannot connect\n");
+    return 1;
+  }
+
+  /* batched write, then read it back as a region */
+  put_u32(req, 4 * 2 + 1); /* column 2, row 1 */
+  req[4] = '7';
+  put_u32(req + 5, 4 * 3 + 1);
+  req[9] = '8';
+  send_frame(fd, 'W', req, 10);
+  memset(req, 0, 8);
+  req[0] = 2; /* x */
+  req[4] = 2; /* w */
+  req[6] = 4; /* h */
+  send_frame(fd, 'R', req, 8);
+  type = recv_frame(fd, r, ecl, buf, sizeof(buf));
+  if (type != 'r' || get_u32(buf + 1) != 8 + 8 || buf[5 + 8 + 1] != '7' || buf[5 + 8 + 5] != '8')
+  {
+    printf("remote: bad region reply\n");
+    ok = 0;
+  }
+
+  /* subscribe: a keyframe, then a delta per tick, rebuilding a copy */
+  req[0] = 1;
+  send_frame(fd, 'S', req, 1);
+  for (i = 0; i < 3 && ok; i++)
+  {
+    if (i > 0)
+    {
+      ecl_set(ecl, i, '1');
+      ecl_eval(ecl);
+    }
+    type = recv_frame(fd, r, ecl, buf, sizeof(buf));
+    if (type != 'm' || buf[5] != (i ? 'D' : 'K') ||
+        !mirror_decode(m, copy, buf + 5, get_u32(buf + 1)) ||
+        copy->clock != ecl->clock || memcmp(copy->mem, ecl->mem, ecl->memsz))
+    {
+      printf("remote: bad mirror message %d\n", i);
+      ok = 0;
+    }
+  }
+
+  close(fd);
+  remote_free(r);
+  mirror_free(m);
+  ecl_free(copy);
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "remote ok" : "remote FAILED");
+  return !ok;
+}
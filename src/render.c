@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "canvas.h"
+#include "ecl.h"
+#include "macro.h"
+
+/* Offline renderer: runs a memory for a number of ticks and writes every
+   tick as a video frame drawn like the editor draws it, as a Y4M stream or
+   raw RGBA, to a file or a pipe. Ticks are captured in batches and the
+   frames of a batch are drawn and converted on several threads, then
+   written in order, so no frame is ever dropped.
+
+   render -f prog.ecl -n 600 -o - | ffmpeg -i - piece.mp4 */
+
+#define MAX_LAYERS 16
+#define MAX_THREADS 64
+#define BATCH 8 /* frames per thread in a batch */
+
+typedef struct job_t
+{
+    const char *cells;
+    const unsigned char *styles;
+    unsigned char *out; /* frames of the batch, frame_size apart */
+    int memsz, frame_size, count, stride, first, y4m;
+    canvas_t *canvas;
+} job_t;
+
+/* Draw and convert frames first, first + stride, ... of a batch */
+static void *encode(void *arg)
+{
+    job_t *job = arg;
+    int k;
+
+    for (k = job->first; k < job->count; k += job->stride)
+    {
+        canvas_draw(job->canvas, job->cells + (size_t)k * job->memsz,
+                    job->styles + (size_t)k * job->memsz, 0, 0, 0, 0);
+        if (job->y4m)
+        {
+            canvas_yuv(job->canvas, job->out + (size_t)k * job->frame_size);
+        }
+        else
+        {
+            canvas_rgba(job->canvas, job->out + (size_t)k * job->frame_size);
+        }
+    }
+    return 0;
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int i, k, n, nlayers = 0, nmacros = 0, nclocks = 0, hor = 32, ver = 48, ticks = 600, fps = 30, threads = 4, y4m = 1;
+    int memsz, frame_size, batch, ok, done = 0;
+    const char *fn = 0, *path = "-";
+    const char *layers[MAX_LAYERS];
+    const char *macros[BASE36];
+    const char *clocks[ECL_CLOCKS];
+    pthread_t tids[MAX_THREADS];
+    job_t jobs[MAX_THREADS];
+    unsigned char *styles, *frames;
+    char *cells;
+    FILE *out;
+    ecl_t *ecl;
+    double t0;
+
+    for (i = 1; i < argc - 1; i++)
+    {
+        if (!strcmp(argv[i], "-f"))
+        {
+            fn = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-c")) /* columns on a clock of their own, id=col,cols,mul/div */
+        {
+            if (nclocks < ECL_CLOCKS)
+            {
+                clocks[nclocks++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-k")) /* macro run by K cells, id=path */
+        {
+            if (nmacros < BASE36)
+            {
+                macros[nmacros++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-l")) /* module file laid over the grid, path@x,y */
+        {
+            if (nlayers < MAX_LAYERS)
+            {
+                layers[nlayers++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-w")) /* grid columns */
+        {
+            hor = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-h")) /* grid rows */
+        {
+            ver = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-n")) /* ticks, one frame each */
+        {
+            ticks = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-r")) /* frame rate written to the Y4M header */
+        {
+            fps = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-j")) /* encoding threads */
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t")) /* y4m or rgba */
+        {
+            y4m = strcmp(argv[++i], "rgba") != 0;
+        }
+        else if (!strcmp(argv[i], "-o")) /* output file, - for stdout */
+        {
+            path = argv[++i];
+        }
+    }
+    if (hor < 1 || ver < 1 || ticks < 0 || fps < 1)
+    {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+    threads = threads < 1 ? 1 : threads > MAX_THREADS ? MAX_THREADS : threads;
+
+    /* commands print to stdout; keep that away from a video on stdout */
+    if (!strcmp(path, "-"))
+    {
+        out = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    else
+    {
+        out = fopen(path, "wb");
+    }
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+
+    ecl = ecl_new(hor, ver, (unsigned long)42);
+    if (fn)
+    {
+        FILE *file = fopen(fn, "r");
+        if (!file || !ecl_load(ecl, file))
+        {
+            fprintf(stderr, "Failed to load %s\n", fn);
+        }
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+    for (i = 0; i < nclocks; i++)
+    {
+        if (!ecl_clock_spec(ecl, clocks[i]))
+        {
+            fprintf(stderr, "Bad clock %s\n", clocks[i]);
+        }
+    }
+    for (i = 0; i < nmacros; i++)
+    {
+        if (!macro_load(ecl, macros[i]))
+        {
+            fprintf(stderr, "Failed to load macro %s\n", macros[i]);
+        }
+    }
+    for (i = 0; i < nlayers; i++)
+    {
+        if (!ecl_load_module(ecl, layers[i]))
+        {
+            fprintf(stderr, "Failed to load layer %s\n", layers[i]);
+        }
+    }
+
+    /* a canvas per thread; all the same size */
+    for (k = 0, ok = 1; k < threads; k++)
+    {
+        jobs[k].canvas = canvas_new(hor, ver, 8);
+        ok = ok && jobs[k].canvas;
+    }
+    memsz = ecl->memsz;
+    batch = threads * BATCH;
+    frame_size = ok ? jobs[0].canvas->width * jobs[0].canvas->height * (y4m ? 3 : 4) : 0;
+    cells = malloc((size_t)batch * memsz);
+    styles = malloc((size_t)batch * memsz);
+    frames = malloc((size_t)batch * frame_size);
+    if (!ok || !cells || !styles || !frames)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    if (y4m)
+    {
+        fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                jobs[0].canvas->width, jobs[0].canvas->height, fps);
+    }
+
+    t0 = seconds();
+    while (done < ticks)
+    {
+        n = ticks - done < batch ? ticks - done : batch;
+        for (k = 0; k < n; k++)
+        {
+            ecl_eval(ecl);
+            canvas_capture(ecl, cells + (size_t)k * memsz, styles + (size_t)k * memsz);
+        }
+        for (k = 0; k < threads; k++)
+        {
+            jobs[k].cells = cells;
+            jobs[k].styles = styles;
+            jobs[k].out = frames;
+            jobs[k].memsz = memsz;
+            jobs[k].frame_size = frame_size;
+            jobs[k].count = n;
+            jobs[k].stride = threads;
+            jobs[k].first = k;
+            jobs[k].y4m = y4m;
+            if (k > 0 && pthread_create(&tids[k], 0, encode, &jobs[k]))
+            {
+                encode(&jobs[k]); /* no thread; do it here */
+                jobs[k].count = -1;
+            }
+        }
+        encode(&jobs[0]);
+        for (k = 1; k < threads; k++)
+        {
+            if (jobs[k].count >= 0)
+            {
+                pthread_join(tids[k], 0);
+            }
+        }
+        for (k = 0; k < n; k++)
+        {
+            if (y4m)
+            {
+                fputs("FRAME\n", out);
+            }
+            fwrite(frames + (size_t)k * frame_size, 1, frame_size, out);
+        }
+        done += n;
+    }
+    fflush(out);
+    t0 = seconds() - t0;
+    fprintf(stderr, "rendered %d frames of %dx%d in %.2f s, %.0f frames/s\n",
+            done, jobs[0].canvas->width, jobs[0].canvas->height, t0, t0 > 0 ? done / t0 : 0.0);
+
+    fclose(out);
+    for (k = 0; k < threads; k++)
+    {
+        canvas_free(jobs[k].canvas);
+    }
+    free(frames);
+    free(styles);
+    free(cells);
+    ecl_free(ecl);
+    return 0;
+}
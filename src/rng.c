@@ -26,8 +26,19 @@ struct rng_t {
   double saved;
 };
 
+size_t rng_size(void) {
+  return sizeof(rng_t);
+}
+
 rng_t* rng_new(unsigned long seed) {
   rng_t* rng = calloc(1, sizeof(rng_t));
+  return rng ? rng_init(rng, seed) : 0;
+}
+
+rng_t* rng_init(void* mem, unsigned long seed) {
+  rng_t* rng = mem;
+  rng->has_saved = 0;
+  rng->saved = 0;
   /* setting initial seeds to mt[N] using         */
   /* the generator Line 25 of Table 1 in          */
   /* [KNUTH 1981, The Art of Computer Programming */
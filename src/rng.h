@@ -5,9 +5,18 @@
 /* The RNG itself containing current state */
 typedef struct rng_t rng_t;
 
+#include <stddef.h>
+
 /* Create and initialize a RNG; a seed of zero uses current time */
 rng_t* rng_new(unsigned long seed);
 
+/* Bytes needed to hold a RNG */
+size_t rng_size(void);
+
+/* Initialize a RNG in caller-provided memory of rng_size() bytes; nothing
+   is allocated, do not rng_free it */
+rng_t* rng_init(void* mem, unsigned long seed);
+
 /* generates a random number with 53-bit resolution. NOTE: returns
    doubles in [0,1) -- excluding zero, but including 1. */
 double rng_double(rng_t* rng);
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(4, 8, (unsigned long)1);
+  int ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* U0a sends on the channel Ta listens on; Uzz reaches past the first 36 */
+  ecl_blit(ecl, 0, 0, "5U0a....", 1, 8, 0);
+  ecl_blit(ecl, 1, 0, "Ta......", 1, 8, 0);
+  ecl_blit(ecl, 2, 0, "Uzz.....", 1, 8, 0);
+  ecl_blit(ecl, 3, 0, "7Uzz....", 1, 8, 0);
+  ecl_eval(ecl);
+  if (ecl_get(ecl, 1 * 8 + 2) != '5' || ecl_get(ecl, 0 * 8 + 4) != '5' ||
+      ecl_get(ecl, 2 * 8 + 3) != '7' || ecl_get(ecl, 3 * 8 + 4) != '7')
+  {
+    printf("teleport: bad delivery\n");
+    ok = 0;
+  }
+  if (ecl_stats(ecl)->teleports != 4)
+  {
+    printf("teleport: %lu deliveries, expected 4\n", ecl_stats(ecl)->teleports);
+    ok = 0;
+  }
+
+  /* channels only carry a value for the tick it was sent */
+  ecl_eval(ecl);
+  if (ecl_stats(ecl)->teleports != 4 || ecl->nsent != 0)
+  {
+    printf("teleport: channels not cleared\n");
+    ok = 0;
+  }
+
+  /* a receiver retuned by an edit is found on its new channel */
+  ecl_set(ecl, 1 * 8 + 1, 'z');
+  ecl_blit(ecl, 2, 0, "Uzz", 1, 3, 0);
+  ecl_blit(ecl, 3, 0, "7U0z", 1, 4, 0);
+  ecl_eval(ecl);
+  if (ecl_get(ecl, 1 * 8 + 2) != '7')
+  {
+    printf("teleport: edited channel not delivered\n");
+    ok = 0;
+  }
+
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "teleport ok" : "teleport FAILED");
+  return !ok;
+}
@@ -0,0 +1,793 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "block.h"
+#include "canvas.h"
+#include "ecl.h"
+#include "journal.h"
+#include "macro.h"
+#include "output.h"
+#include "remote.h"
+#include "timeline.h"
+
+/* Text mode frontend for terminals and SSH sessions: draws the grid with
+   ANSI escapes, one character a cell, and edits it with the keys of the
+   window frontend. A shadow copy of the screen is kept so each frame only
+   sends the cells that changed since the last one, and a whole frame goes
+   out in a single write. */
+
+#define MAX_LAYERS 16
+#define FPS 60
+
+/* Keys beyond a byte, and the modifiers terminals report with them */
+enum
+{
+    KEY_ESCAPE = 27,
+    KEY_BACKSPACE = 127,
+    KEY_UP = 256,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_DELETE,
+    KEY_SHIFT = 1 << 10,
+    KEY_CTRL = 1 << 11
+};
+
+#define CTRL_KEY(c) ((c) & 31)
+
+/* Screen attributes: the canvas styles, then the selection */
+#define ATTR_SELECTED 6
+
+static const char *attrs[] = {
+    "0",       /* outside the grid */
+    "0;90",    /* CANVAS_EMPTY */
+    "0;36",    /* CANVAS_VALUE */
+    "0;30;46", /* CANVAS_COMMAND */
+    "0;97",
+    "0;30;47", /* CANVAS_FIRED */
+    "0;30;43"  /* ATTR_SELECTED */
+};
+
+typedef struct term_t
+{
+    ecl_t *ecl;
+    timeline_t *timeline;
+    journal_t *journal;
+    outputs_t *outputs;
+    remote_t *remote;
+    block_t *clip;
+    int hor, ver;        /* grid columns and rows */
+    int x, y, w, h;      /* selection */
+    int vx, vy;          /* grid cell at the top left of the screen */
+    int cols, rows;      /* screen size; the last row is the status line */
+    int pause, down, quit;
+    unsigned short *shown; /* what each screen cell shows: glyph | attr << 8 */
+    char status[128];      /* the status line on screen */
+    char *out;             /* output of the frame being drawn */
+    size_t len, size;
+    int fd; /* the terminal */
+} term_t;
+
+static struct termios saved;
+static int saved_fd = -1;
+static volatile sig_atomic_t resized = 1, stop = 0;
+
+static void on_signal(int sig)
+{
+    if (sig == SIGWINCH)
+    {
+        resized = 1;
+    }
+    else
+    {
+        stop = 1;
+    }
+}
+
+static double seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int clamp(int val, int min, int max)
+{
+    return (val >= min) ? (val <= max) ? val : max : min;
+}
+
+/* Write all of buf, riding out signals and short writes */
+static void write_all(int fd, const char *buf, size_t n)
+{
+    ssize_t k;
+
+    while (n > 0)
+    {
+        k = write(fd, buf, n);
+        if (k < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (k <= 0)
+        {
+            return;
+        }
+        buf += k;
+        n -= (size_t)k;
+    }
+}
+
+/* Raw input, alternate screen, hidden cursor, mouse drags reported */
+static void term_enter(int fd)
+{
+    static const char init[] = "\x1b[?1049h\x1b[?25l\x1b[?1002h\x1b[?1006h\x1b[0m\x1b[2J";
+    struct termios raw;
+
+    if (tcgetattr(STDIN_FILENO, &saved) == 0)
+    {
+        saved_fd = fd;
+        raw = saved;
+        raw.c_iflag &= ~(tcflag_t)(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+        raw.c_oflag &= ~(tcflag_t)OPOST;
+        raw.c_cflag |= CS8;
+        raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | IEXTEN | ISIG);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+    }
+    write_all(fd, init, sizeof(init) - 1);
+}
+
+/* Undo term_enter; also run at exit */
+static void term_leave(void)
+{
+    static const char fini[] = "\x1b[0m\x1b[?1006l\x1b[?1002l\x1b[?25h\x1b[?1049l";
+
+    if (saved_fd >= 0)
+    {
+        write_all(saved_fd, fini, sizeof(fini) - 1);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+        saved_fd = -1;
+    }
+}
+
+/* Append to the frame */
+static void put(term_t *t, const char *s, size_t n)
+{
+    char *out;
+
+    if (t->len + n > t->size)
+    {
+        t->size = (t->len + n) * 2;
+        out = realloc(t->out, t->size);
+        if (!out)
+        {
+            t->size = 0;
+            return;
+        }
+        t->out = out;
+    }
+    memcpy(t->out + t->len, s, n);
+    t->len += n;
+}
+
+static void putf(term_t *t, const char *fmt, int a, int b)
+{
+    char s[32];
+    int n = snprintf(s, sizeof(s), fmt, a, b);
+
+    put(t, s, (size_t)n);
+}
+
+/* Pick up the screen size; everything is sent again after a resize */
+static void term_resize(term_t *t)
+{
+    struct winsize ws;
+    unsigned short *shown;
+    int n;
+
+    resized = 0;
+    if (ioctl(t->fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 1)
+    {
+        t->cols = ws.ws_col;
+        t->rows = ws.ws_row;
+    }
+    n = t->cols * t->rows;
+    shown = realloc(t->shown, (size_t)n * sizeof(t->shown[0]));
+    if (!shown)
+    {
+        return;
+    }
+    t->shown = shown;
+    memset(t->shown, 0xff, (size_t)n * sizeof(t->shown[0]));
+    t->status[0] = '\0';
+    put(t, "\x1b[0m\x1b[2J", 8);
+}
+
+/* Scroll so the cursor stays on screen */
+static void term_follow(term_t *t)
+{
+    int rows = t->rows - 1;
+
+    if (t->x < t->vx)
+        t->vx = t->x;
+    if (t->x >= t->vx + t->cols)
+        t->vx = t->x - t->cols + 1;
+    if (t->y < t->vy)
+        t->vy = t->y;
+    if (t->y >= t->vy + rows)
+        t->vy = t->y - rows + 1;
+    t->vx = clamp(t->vx, 0, t->hor > t->cols ? t->hor - t->cols : 0);
+    t->vy = clamp(t->vy, 0, t->ver > rows ? t->ver - rows : 0);
+}
+
+/* Send the cells that differ from what the screen shows, then the status
+   line if it changed, all in one write. The cursor is only moved when the
+   next changed cell does not follow the last one written, and colors are
+   only set when they change. */
+static void term_draw(term_t *t)
+{
+    int sx, sy, col, row, i, g, a, px = -1, py = -1, last = -1;
+    unsigned short cell, *shown;
+    char c, status[sizeof(t->status)];
+
+    if (resized)
+    {
+        term_resize(t);
+    }
+    if (!t->shown)
+    {
+        return;
+    }
+    term_follow(t);
+    for (sy = 0; sy < t->rows - 1; sy++)
+    {
+        shown = t->shown + sy * t->cols;
+        row = t->vy + sy;
+        for (sx = 0; sx < t->cols; sx++)
+        {
+            col = t->vx + sx;
+            if (col < t->hor && row < t->ver)
+            {
+                i = col * t->ver + row;
+                a = canvas_style(t->ecl, i);
+                g = canvas_glyph(col, row, t->ecl->mem[i], a, 0);
+                if (col >= t->x && col < t->x + t->w && row >= t->y && row < t->y + t->h)
+                {
+                    a = ATTR_SELECTED;
+                }
+            }
+            else
+            {
+                g = ' ';
+                a = 0;
+            }
+            g = g > ' ' && g < 127 ? g : ' ';
+            cell = (unsigned short)(g | a << 8);
+            if (shown[sx] == cell)
+            {
+                continue;
+            }
+            shown[sx] = cell;
+            if (sx != px || sy != py)
+            {
+                putf(t, "\x1b[%d;%dH", sy + 1, sx + 1);
+            }
+            if (a != last)
+            {
+                put(t, "\x1b[", 2);
+                put(t, attrs[a], strlen(attrs[a]));
+                put(t, "m", 1);
+                last = a;
+            }
+            c = (char)g;
+            put(t, &c, 1);
+            px = sx + 1;
+            py = sy;
+        }
+    }
+
+    snprintf(status, sizeof(status), "%s tick %d  %d,%d  %dx%d  grid %dx%d",
+             t->pause ? "||" : ">", t->ecl->clock, t->x, t->y, t->w, t->h, t->hor, t->ver);
+    status[t->cols < (int)sizeof(status) ? t->cols : (int)sizeof(status) - 1] = '\0';
+    if (strcmp(status, t->status))
+    {
+        strcpy(t->status, status);
+        putf(t, "\x1b[%d;%dH\x1b[0m", t->rows, 1);
+        put(t, status, strlen(status));
+        put(t, "\x1b[K", 3);
+    }
+    if (t->len > 0)
+    {
+        write_all(t->fd, t->out, t->len);
+        t->len = 0;
+    }
+}
+
+static void do_select(term_t *t, int x, int y, int w, int h)
+{
+    t->x = clamp(x, 0, t->hor - 1);
+    t->y = clamp(y, 0, t->ver - 1);
+    t->w = clamp(w, 1, 36);
+    t->h = clamp(h, 1, 36);
+}
+
+static void do_move(term_t *t, int dx, int dy)
+{
+    do_select(t, t->x + dx, t->y + dy, t->w, t->h);
+}
+
+static void do_insert(term_t *t, char c)
+{
+    journal_begin(t->journal);
+    journal_set(t->journal, t->ecl, t->x * t->ver + t->y, c);
+    journal_end(t->journal, t->ecl);
+}
+
+/* Step the memory by delta ticks, replaying recorded history where we have it.
+   Random draws replay as recorded; macro instances are not rewound. */
+static void do_seek(term_t *t, int delta)
+{
+    t->pause = 1;
+    if (!timeline_seek(t->timeline, t->ecl, t->ecl->clock + delta) && delta > 0)
+    {
+        ecl_eval(t->ecl);
+        timeline_record(t->timeline, t->ecl);
+    }
+}
+
+/* Turn the selected cells a quarter clockwise, or mirror them */
+static void transform_selection(term_t *t, int rotate)
+{
+    block_t b = {0, 0, 0, 0};
+    int side = t->w > t->h ? t->w : t->h;
+
+    if (!block_copy(&b, t->ecl, t->x, t->y, t->w, t->h))
+    {
+        return;
+    }
+    if (rotate)
+    {
+        block_rotate(&b);
+    }
+    else
+    {
+        block_flip(&b, 0);
+    }
+    journal_begin(t->journal);
+    journal_touch_rect(t->journal, t->ecl, t->x, t->y, side, side);
+    block_fill(0, t->ecl, t->x, t->y, t->w, t->h, '.');
+    block_paste(&b, 0, t->ecl, t->x, t->y);
+    journal_end(t->journal, t->ecl);
+    free(b.cells);
+    do_select(t, t->x, t->y, b.w, b.h);
+}
+
+/* The keymap of the window frontend, as far as a terminal can tell keys
+   apart: ctrl+shift+z and ctrl+shift+f do not exist, so redo is ctrl+y
+   only and ctrl+f always flips left to right. Shift with the arrows grows
+   the selection like a mouse drag. */
+static void term_key(term_t *t, int key)
+{
+    int dx = 0, dy = 0;
+
+    switch (key & ~(KEY_SHIFT | KEY_CTRL))
+    {
+    case KEY_UP:
+        dy = -1;
+        break;
+    case KEY_DOWN:
+        dy = 1;
+        break;
+    case KEY_LEFT:
+        dx = -1;
+        break;
+    case KEY_RIGHT:
+        dx = 1;
+        break;
+    }
+    if (dx || dy)
+    {
+        if (key & KEY_CTRL)
+        {
+            block_move(t->journal, t->ecl, t->x, t->y, t->w, t->h, dx, dy);
+            do_move(t, dx, dy);
+        }
+        else if (key & KEY_SHIFT)
+        {
+            do_select(t, t->x, t->y, t->w + dx, t->h + dy);
+        }
+        else
+        {
+            do_move(t, dx, dy);
+        }
+        return;
+    }
+
+    switch (key)
+    {
+    case CTRL_KEY('q'):
+        t->quit = 1;
+        break;
+    case CTRL_KEY('l'): /* redraw everything */
+        resized = 1;
+        break;
+    case CTRL_KEY('x'):
+        block_cut(t->clip, t->journal, t->ecl, t->x, t->y, t->w, t->h);
+        break;
+    case CTRL_KEY('c'):
+        block_copy(t->clip, t->ecl, t->x, t->y, t->w, t->h);
+        break;
+    case CTRL_KEY('v'):
+        block_paste(t->clip, t->journal, t->ecl, t->x, t->y);
+        break;
+    case CTRL_KEY('z'):
+        journal_undo(t->journal, t->ecl);
+        break;
+    case CTRL_KEY('y'):
+        journal_redo(t->journal, t->ecl);
+        break;
+    case CTRL_KEY('r'):
+        transform_selection(t, 1);
+        break;
+    case CTRL_KEY('f'):
+        transform_selection(t, 0);
+        break;
+    case ' ':
+        t->pause = !t->pause;
+        break;
+    case '[':
+        do_seek(t, -1);
+        break;
+    case ']':
+        do_seek(t, 1);
+        break;
+    case KEY_ESCAPE:
+        do_select(t, 0, 0, 1, 1);
+        break;
+    case KEY_BACKSPACE:
+    case CTRL_KEY('h'):
+        do_insert(t, 0);
+        break;
+    case KEY_DELETE:
+        block_fill(t->journal, t->ecl, t->x, t->y, t->w, t->h, '.');
+        break;
+    case '/':
+        do_insert(t, '?');
+        break;
+    default:
+        if (key < 127 && valid_char((char)key) && key != '.')
+        {
+            do_insert(t, (char)key);
+        }
+        break;
+    }
+}
+
+/* An SGR mouse report: press selects a cell, dragging stretches it */
+static void term_mouse(term_t *t, int button, int sx, int sy, int release)
+{
+    int col = t->vx + sx - 1, row = t->vy + sy - 1;
+
+    if (release)
+    {
+        t->down = 0;
+    }
+    else if (button == 0)
+    {
+        do_select(t, col, row, 1, 1);
+        t->down = 1;
+    }
+    else if (button == 32 && t->down)
+    {
+        do_select(t, t->x, t->y, col - t->x + 1, row - t->y + 1);
+    }
+}
+
+/* Decode the keys in buf; returns the bytes used. An escape sequence cut
+   short at the end of buf is left for the next read, unless it is all
+   there will be. */
+static int term_input(term_t *t, const char *buf, int n, int last)
+{
+    int i = 0, j, k, p[3], np, key;
+
+    while (i < n)
+    {
+        if (buf[i] != 27)
+        {
+            term_key(t, (unsigned char)buf[i++]);
+            continue;
+        }
+        if (i + 1 >= n || (buf[i + 1] != '[' && buf[i + 1] != 'O'))
+        {
+            if (i + 1 >= n && !last)
+            {
+                return i;
+            }
+            term_key(t, KEY_ESCAPE);
+            i++;
+            continue;
+        }
+
+        /* CSI: ESC [ params final, or ESC [ < b;x;y M for the mouse */
+        j = i + 2;
+        np = 0;
+        p[0] = p[1] = p[2] = 0;
+        if (j < n && buf[j] == '<')
+        {
+            j++;
+        }
+        for (; j < n && ((buf[j] >= '0' && buf[j] <= '9') || buf[j] == ';'); j++)
+        {
+            if (buf[j] == ';')
+            {
+                np += np < 2;
+            }
+            else
+            {
+                p[np] = p[np] * 10 + buf[j] - '0';
+            }
+        }
+        if (j >= n)
+        {
+            if (!last)
+            {
+                return i;
+            }
+            break;
+        }
+        k = np > 0 && p[1] > 0 ? p[1] - 1 : 0; /* modifiers: 1 shift, 4 ctrl */
+        key = (k & 1 ? KEY_SHIFT : 0) | (k & 4 ? KEY_CTRL : 0);
+        switch (buf[j])
+        {
+        case 'A':
+            term_key(t, KEY_UP | key);
+            break;
+        case 'B':
+            term_key(t, KEY_DOWN | key);
+            break;
+        case 'C':
+            term_key(t, KEY_RIGHT | key);
+            break;
+        case 'D':
+            term_key(t, KEY_LEFT | key);
+            break;
+        case '~':
+            if (p[0] == 3)
+            {
+                term_key(t, KEY_DELETE);
+            }
+            break;
+        case 'M':
+        case 'm':
+            if (buf[i + 2] == '<')
+            {
+                term_mouse(t, p[0], p[1], p[2], buf[j] == 'm');
+            }
+            break;
+        }
+        i = j + 1;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int i, k, n, nouts = 0, nlayers = 0, nmacros = 0, nclocks = 0, pending = 0, period = 250;
+    const char *fn = 0, *remote = 0;
+    const char *outs[OUTPUT_MAX_SINKS];
+    const char *layers[MAX_LAYERS];
+    const char *macros[BASE36];
+    const char *clocks[ECL_CLOCKS];
+    char buf[256];
+    double now, next, tick;
+    struct sigaction sa;
+    struct pollfd pfd;
+    term_t t;
+
+    memset(&t, 0, sizeof(t));
+    t.hor = 32;
+    t.ver = 48;
+    for (i = 1; i < argc - 1; i++)
+    {
+        if (!strcmp(argv[i], "-f"))
+        {
+            fn = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-c")) /* columns on a clock of their own, id=col,cols,mul/div */
+        {
+            if (nclocks < ECL_CLOCKS)
+            {
+                clocks[nclocks++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-k")) /* macro run by K cells, id=path */
+        {
+            if (nmacros < BASE36)
+            {
+                macros[nmacros++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-l")) /* module file laid over the grid, path@x,y */
+        {
+            if (nlayers < MAX_LAYERS)
+            {
+                layers[nlayers++] = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-w")) /* grid columns */
+        {
+            t.hor = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-h")) /* grid rows */
+        {
+            t.ver = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t")) /* milliseconds per tick */
+        {
+            period = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-r")) /* unix socket path or tcp:port */
+        {
+            remote = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-o")) /* udp:host:port, shm:path or file:path */
+        {
+            if (nouts < OUTPUT_MAX_SINKS)
+            {
+                outs[nouts++] = argv[++i];
+            }
+        }
+    }
+    if (t.hor < 1 || t.ver < 1)
+    {
+        printf("Invalid grid size %dx%d\n", t.hor, t.ver);
+        return 1;
+    }
+    period = period < 1 ? 1 : period;
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO))
+    {
+        printf("Not a terminal\n");
+        return 1;
+    }
+
+    t.ecl = ecl_new(t.hor, t.ver, (unsigned long)42);
+    t.timeline = timeline_new(64, 30 * 60 * 10);
+    t.journal = journal_new();
+    t.clip = block_new();
+    t.outputs = outputs_new();
+    for (i = 0; i < nouts; i++)
+    {
+        if (!outputs_add(t.outputs, output_parse(outs[i])))
+        {
+            printf("Failed to open output %s\n", outs[i]);
+        }
+    }
+    ecl_set_output_batch(t.ecl, &outputs_send, t.outputs);
+    if (remote)
+    {
+        t.remote = remote_new(remote);
+    }
+    if (fn)
+    {
+        FILE *file = fopen(fn, "r");
+        if (!file || !ecl_load(t.ecl, file))
+        {
+            printf("Failed to load %s\n", fn);
+        }
+        if (file)
+        {
+            fclose(file);
+        }
+    }
+    for (i = 0; i < nclocks; i++)
+    {
+        if (!ecl_clock_spec(t.ecl, clocks[i]))
+        {
+            printf("Bad clock %s\n", clocks[i]);
+        }
+    }
+    for (i = 0; i < nmacros; i++)
+    {
+        if (!macro_load(t.ecl, macros[i]))
+        {
+            printf("Failed to load macro %s\n", macros[i]);
+        }
+    }
+    for (i = 0; i < nlayers; i++)
+    {
+        if (!ecl_load_module(t.ecl, layers[i]))
+        {
+            printf("Failed to load layer %s\n", layers[i]);
+        }
+    }
+    timeline_record(t.timeline, t.ecl);
+    do_select(&t, 0, 0, 1, 1);
+
+    /* commands print to stdout; keep that off the screen */
+    fflush(stdout);
+    t.fd = dup(STDOUT_FILENO);
+    k = open("/dev/null", O_WRONLY);
+    if (k >= 0)
+    {
+        dup2(k, STDOUT_FILENO);
+        close(k);
+    }
+    t.cols = 80;
+    t.rows = 24;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGTERM, &sa, 0);
+    sigaction(SIGHUP, &sa, 0);
+    sigaction(SIGINT, &sa, 0);
+    sigaction(SIGWINCH, &sa, 0);
+    term_enter(t.fd);
+    atexit(term_leave);
+
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    next = tick = seconds();
+    while (!t.quit && !stop)
+    {
+        now = seconds();
+        k = next > now ? (int)((next - now) * 1e3) + 1 : 0;
+        if (poll(&pfd, 1, k) > 0)
+        {
+            n = (int)read(STDIN_FILENO, buf + pending, sizeof(buf) - pending);
+            if (n > 0)
+            {
+                n += pending;
+                k = term_input(&t, buf, n, n == (int)sizeof(buf));
+                pending = n - k;
+                memmove(buf, buf + k, (size_t)pending);
+            }
+        }
+        else if (pending > 0)
+        { /* a lone escape: nothing followed it within a frame */
+            term_input(&t, buf, pending, 1);
+            pending = 0;
+        }
+        if (seconds() < next)
+        {
+            continue;
+        }
+
+        now = seconds();
+        if (!t.pause && now >= tick)
+        {
+            ecl_eval(t.ecl);
+            timeline_record(t.timeline, t.ecl);
+            tick += period / 1e3;
+            tick = tick < now ? now + period / 1e3 : tick;
+        }
+        remote_tick(t.remote, t.ecl);
+        term_draw(&t);
+        next += 1.0 / FPS;
+        next = next < now ? now : next;
+    }
+
+    term_leave();
+    close(t.fd);
+    free(t.shown);
+    free(t.out);
+    remote_free(t.remote);
+    outputs_free(t.outputs);
+    block_free(t.clip);
+    journal_free(t.journal);
+    timeline_free(t.timeline);
+    ecl_free(t.ecl);
+    return 0;
+}
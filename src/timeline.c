@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "delta.h"
+#include "timeline.h"
+
+/* A keyframe and the deltas of the ticks that follow it. All segments but
+   the newest hold exactly interval ticks. */
+typedef struct
+{
+    int tick,           /* tick of the keyframe */
+        count;          /* ticks held, keyframe included */
+    unsigned char *key; /* full frame at tick */
+    unsigned char *log; /* deltas for tick + 1 .. tick + count - 1 */
+    size_t len, cap;
+    size_t *ends; /* end offset in log of each delta */
+} segment_t;
+
+struct timeline_t
+{
+    int interval,
+        max_segs,
+        framesz, /* bytes per frame: a delta frame, then the RNG */
+        head,    /* ring index of the oldest segment */
+        nsegs;
+    segment_t *segs;
+    unsigned char *prev; /* last recorded frame */
+    unsigned char *cur;  /* scratch frame */
+};
+
+/* Bytes in a frame of ecl: the frame of delta.h and the RNG state, so that
+   draws after a seek are those that followed the tick when recorded */
+static int frame_size(ecl_t *ecl)
+{
+    return delta_frame_size(ecl) + (int)rng_size();
+}
+
+static segment_t *seg(timeline_t *tl, int i)
+{
+    return &tl->segs[(tl->head + i) % tl->max_segs];
+}
+
+static int log_reserve(segment_t *s, size_t n)
+{
+    unsigned char *log;
+    size_t cap;
+
+    if (s->len + n <= s->cap)
+    {
+        return 1;
+    }
+    cap = s->cap ? s->cap : 256;
+    while (cap < s->len + n)
+    {
+        cap *= 2;
+    }
+    log = realloc(s->log, cap);
+    if (!log)
+    {
+        return 0;
+    }
+    s->log = log;
+    s->cap = cap;
+    return 1;
+}
+
+/* Rebuild the frame at tick from the keyframe of s */
+static void decode(timeline_t *tl, segment_t *s, int tick, unsigned char *frame)
+{
+    size_t start;
+    int i;
+
+    memcpy(frame, s->key, tl->framesz);
+    for (i = 0; i < tick - s->tick; i++)
+    {
+        start = i ? s->ends[i - 1] : 0;
+        delta_apply(frame, tl->framesz, s->log + start, s->ends[i] - start);
+    }
+}
+
+/* Forget every tick at or after tick, leaving prev at tick - 1 */
+static void forget(timeline_t *tl, int tick)
+{
+    segment_t *s;
+
+    while (tl->nsegs > 0)
+    {
+        s = seg(tl, tl->nsegs - 1);
+        if (s->tick < tick)
+        {
+            s->count = tick - s->tick;
+            s->len = (s->count > 1) ? s->ends[s->count - 2] : 0;
+            decode(tl, s, tick - 1, tl->prev);
+            return;
+        }
+        tl->nsegs--;
+    }
+}
+
+static void release(timeline_t *tl)
+{
+    int i;
+    segment_t *s;
+
+    for (i = 0; i < tl->max_segs; i++)
+    {
+        s = &tl->segs[i];
+        free(s->key);
+        free(s->log);
+        free(s->ends);
+        memset(s, 0, sizeof(segment_t));
+    }
+    free(tl->prev);
+    free(tl->cur);
+    tl->prev = tl->cur = 0;
+    tl->framesz = 0;
+    tl->head = tl->nsegs = 0;
+}
+
+timeline_t *timeline_new(int interval, int max_ticks)
+{
+    timeline_t *tl = calloc(1, sizeof(timeline_t));
+
+    if (tl)
+    {
+        tl->interval = (interval < 1) ? 1 : interval;
+        tl->max_segs = (max_ticks + tl->interval - 1) / tl->interval + 1;
+        if (tl->max_segs < 2)
+        {
+            tl->max_segs = 2;
+        }
+        tl->segs = calloc(tl->max_segs, sizeof(segment_t));
+        if (!tl->segs)
+        {
+            free(tl);
+            return 0;
+        }
+    }
+    return tl;
+}
+
+void timeline_free(timeline_t *tl)
+{
+    if (tl)
+    {
+        release(tl);
+        free(tl->segs);
+        free(tl);
+    }
+}
+
+void timeline_clear(timeline_t *tl)
+{
+    if (tl)
+    {
+        tl->head = tl->nsegs = 0;
+    }
+}
+
+int timeline_first(timeline_t *tl)
+{
+    return (tl && tl->nsegs) ? seg(tl, 0)->tick : 0;
+}
+
+int timeline_last(timeline_t *tl)
+{
+    segment_t *s;
+
+    if (!tl || !tl->nsegs)
+    {
+        return -1;
+    }
+    s = seg(tl, tl->nsegs - 1);
+    return s->tick + s->count - 1;
+}
+
+size_t timeline_bytes(timeline_t *tl)
+{
+    int i;
+    size_t n = 0;
+
+    for (i = 0; tl && i < tl->nsegs; i++)
+    {
+        n += tl->framesz + seg(tl, i)->len;
+    }
+    return n;
+}
+
+int timeline_record(timeline_t *tl, ecl_t *ecl)
+{
+    segment_t *s;
+    unsigned char *t;
+    int tick;
+
+    if (!tl || !ecl)
+    {
+        return 0;
+    }
+    if (frame_size(ecl) != tl->framesz)
+    { /* memory was resized; history no longer applies */
+        release(tl);
+        tl->framesz = frame_size(ecl);
+        tl->prev = malloc(tl->framesz);
+        tl->cur = malloc(tl->framesz);
+        if (!tl->prev || !tl->cur)
+        {
+            release(tl);
+            return 0;
+        }
+    }
+    tick = ecl->clock;
+    if (tl->nsegs > 0 && tick <= timeline_last(tl))
+    {
+        forget(tl, tick);
+    }
+    if (tl->nsegs > 0 && tick != timeline_last(tl) + 1)
+    { /* not contiguous with what we have */
+        tl->head = tl->nsegs = 0;
+    }
+    delta_capture(ecl, tl->cur);
+    memcpy(tl->cur + delta_frame_size(ecl), ecl->rng, rng_size());
+
+    s = tl->nsegs ? seg(tl, tl->nsegs - 1) : 0;
+    if (!s || s->count == tl->interval)
+    {
+        s = seg(tl, tl->nsegs); /* the oldest segment when the ring is full */
+        if (!s->key)
+        {
+            s->key = malloc(tl->framesz);
+            s->ends = malloc(tl->interval * sizeof(size_t));
+            if (!s->key || !s->ends)
+            {
+                free(s->key);
+                free(s->ends);
+                s->key = 0;
+                s->ends = 0;
+                return 0;
+            }
+        }
+        if (tl->nsegs == tl->max_segs)
+        { /* drop the oldest keyframe and its deltas */
+            tl->head = (tl->head + 1) % tl->max_segs;
+            tl->nsegs--;
+        }
+        memcpy(s->key, tl->cur, tl->framesz);
+        s->tick = tick;
+        s->count = 1;
+        s->len = 0;
+        tl->nsegs++;
+    }
+    else
+    {
+        if (!log_reserve(s, delta_bound(tl->framesz)))
+        {
+            return 0;
+        }
+        s->len += delta_encode(tl->prev, tl->cur, tl->framesz, s->log + s->len);
+        s->ends[s->count - 1] = s->len;
+        s->count++;
+    }
+    t = tl->prev;
+    tl->prev = tl->cur;
+    tl->cur = t;
+    return 1;
+}
+
+int timeline_seek(timeline_t *tl, ecl_t *ecl, int tick)
+{
+    if (!tl || !ecl || !tl->nsegs || frame_size(ecl) != tl->framesz)
+    {
+        return 0;
+    }
+    if (tick < timeline_first(tl) || tick > timeline_last(tl))
+    {
+        return 0;
+    }
+    decode(tl, seg(tl, (tick - timeline_first(tl)) / tl->interval), tick, tl->cur);
+    delta_restore(ecl, tl->cur);
+    memcpy(ecl->rng, tl->cur + delta_frame_size(ecl), rng_size());
+    ecl->clock = tick;
+    return 1;
+}
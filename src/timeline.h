@@ -0,0 +1,44 @@
+
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ecl.h"
+
+/* Recorded history of an ECL memory. Every interval ticks a full keyframe of
+   mem, state, vars and the RNG state is stored; the ticks in between are
+   stored as deltas against the previous tick (see delta.h). Seeking to a
+   tick decodes at most interval - 1 deltas, and playing on from there draws
+   the same random values as when the tick was recorded. The memories of
+   macro instances (see macro.h) are not recorded; they keep running from
+   where they were. */
+typedef struct timeline_t timeline_t;
+
+/* Create a timeline with a keyframe every interval ticks, keeping at least
+   max_ticks of history; the oldest keyframe and its deltas are dropped first */
+timeline_t *timeline_new(int interval, int max_ticks);
+
+/* Destroy a timeline and its recorded history */
+void timeline_free(timeline_t *tl);
+
+/* Drop all recorded history */
+void timeline_clear(timeline_t *tl);
+
+/* Record the current state of ecl as tick ecl->clock. Recording a tick at or
+   before the last recorded tick discards the recorded future first. Returns
+   non-zero on success. */
+int timeline_record(timeline_t *tl, ecl_t *ecl);
+
+/* Restore ecl to the state recorded at tick; returns non-zero on success */
+int timeline_seek(timeline_t *tl, ecl_t *ecl, int tick);
+
+/* First and last recorded tick; last is less than first when empty */
+int timeline_first(timeline_t *tl);
+int timeline_last(timeline_t *tl);
+
+/* Bytes currently held by keyframes and deltas */
+size_t timeline_bytes(timeline_t *tl);
+
+#endif
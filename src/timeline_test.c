@@ -0,0 +1,86 @@
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "timeline.h"
+
+#define TICKS 300
+
+static const char *program =
+    "G11.I1.........."
+    "G31..R.4........"
+    "..G21.$1........"
+    "................";
+
+int main(int argc, char **argv)
+{
+  (void)argc;
+  (void)argv;
+
+  ecl_t *ecl = ecl_new(4, 16, 34583);
+  timeline_t *tl = timeline_new(16, TICKS);
+  char *mems = malloc(TICKS * ecl->memsz);
+  int *states = malloc(TICKS * ecl->memsz * sizeof(int));
+  int i, t, fail = 0;
+
+  ecl_load_buffer(ecl, program, strlen(program), 0);
+  for (t = 0; t < TICKS; t++)
+  {
+    memcpy(mems + t * ecl->memsz, ecl->mem, ecl->memsz);
+    memcpy(states + t * ecl->memsz, ecl->state, ecl->memsz * sizeof(int));
+    timeline_record(tl, ecl);
+    ecl_eval(ecl);
+  }
+  printf("recorded %d..%d in %lu bytes\n",
+         timeline_first(tl), timeline_last(tl), (unsigned long)timeline_bytes(tl));
+
+  for (i = 0; i < 100; i++)
+  {
+    t = (i * 97) % TICKS;
+    if (!timeline_seek(tl, ecl, t) ||
+        ecl->clock != t ||
+        memcmp(ecl->mem, mems + t * ecl->memsz, ecl->memsz) ||
+        memcmp(ecl->state, states + t * ecl->memsz, ecl->memsz * sizeof(int)))
+    {
+      printf("seek to %d failed\n", t);
+      fail = 1;
+    }
+  }
+
+  /* playing on after a seek draws the random values it drew before */
+  timeline_seek(tl, ecl, 50);
+  for (t = 50; t < 90; t++)
+  {
+    if (memcmp(ecl->mem, mems + t * ecl->memsz, ecl->memsz))
+    {
+      printf("replay from 50 differs at %d\n", t);
+      fail = 1;
+      break;
+    }
+    ecl_eval(ecl);
+  }
+
+  /* rewinding and recording again discards the recorded future */
+  timeline_seek(tl, ecl, 100);
+  ecl_eval(ecl);
+  timeline_record(tl, ecl);
+  if (timeline_last(tl) != 101)
+  {
+    printf("expected last tick 101, got %d\n", timeline_last(tl));
+    fail = 1;
+  }
+  if (timeline_seek(tl, ecl, TICKS - 1))
+  {
+    printf("seek past the end succeeded\n");
+    fail = 1;
+  }
+
+  printf("%s\n", fail ? "timeline FAILED" : "timeline ok");
+  free(mems);
+  free(states);
+  timeline_free(tl);
+  ecl_free(ecl);
+  return fail;
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ecl.h"
+#include "mirror.h"
+
+int main(int argc, char **argv)
+{
+  ecl_t *ecl = ecl_new(4, 8, (unsigned long)1);
+  ecl_t *copy = ecl_new(4, 8, (unsigned long)1);
+  mirror_t *tx = mirror_new(), *rx = mirror_new();
+  const unsigned char *msg;
+  size_t len;
+  int ok = 1;
+
+  (void)argc;
+  (void)argv;
+
+  /* without wide values an increment saturates at z */
+  ecl_blit(ecl, 0, 0, "zI5.....", 1, 8, 0);
+  ecl_eval(ecl);
+  if (ecl_get(ecl, 3) != 'z' || ecl_get_num(ecl, 3) != 35)
+  {
+    printf("wide: narrow increment gave %c\n", ecl_get(ecl, 3));
+    ok = 0;
+  }
+
+  /* with them it counts on; the glyph shows the value modulo 36 */
+  ecl_reset(ecl);
+  if (!ecl_set_wide(ecl, 1))
+  {
+    printf("wide: out of memory\n");
+    return 1;
+  }
+  ecl_blit(ecl, 0, 0, "zI5.....", 1, 8, 0);
+  ecl_eval(ecl);
+  if (ecl_get(ecl, 3) != '4' || ecl_get_num(ecl, 3) != 40)
+  {
+    printf("wide: increment gave %c, %d\n", ecl_get(ecl, 3), ecl_get_num(ecl, 3));
+    ok = 0;
+  }
+
+  /* values travel whole: falling, and teleported */
+  ecl_blit(ecl, 1, 0, ".T3.....", 1, 8, 0);
+  ecl_blit(ecl, 2, 0, "T3......", 1, 8, 0);
+  ecl_set_num(ecl, 8, 1000);
+  ecl_eval(ecl);
+  if (ecl_get_num(ecl, 4) != 40 || ecl_get_num(ecl, 18) != 1000 || ecl_get(ecl, 18) != 's')
+  {
+    printf("wide: values lost, %d and %d\n", ecl_get_num(ecl, 4), ecl_get_num(ecl, 18));
+    ok = 0;
+  }
+
+  /* writing a glyph resets the value */
+  ecl_set(ecl, 4, '7');
+  if (ecl_get_num(ecl, 4) != 7)
+  {
+    printf("wide: glyph write kept the old value\n");
+    ok = 0;
+  }
+
+  /* a mirror carries wide values, and makes its receiver wide */
+  len = mirror_encode(tx, ecl, 1, &msg);
+  if (!len || !mirror_decode(rx, copy, msg, len) || !copy->wide ||
+      ecl_get_num(copy, 18) != 1000 || memcmp(copy->mem, ecl->mem, ecl->memsz))
+  {
+    printf("wide: mirror lost the values\n");
+    ok = 0;
+  }
+
+  mirror_free(tx);
+  mirror_free(rx);
+  ecl_free(copy);
+  ecl_free(ecl);
+
+  printf("%s\n", ok ? "wide ok" : "wide FAILED");
+  return !ok;
+}